@@ -0,0 +1,362 @@
+#include "cache.h"
+#include "sparse_matrix.h"
+#include "eigen.h"
+#include "factorization.h"
+#include "matrix.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char matrix_magic[8] = {'T', 'O', 'M', 'O', 'C', 'S', 'C', '5'};
+static const char factorization_magic[8] = {'T', 'O', 'M', 'O', 'S', 'V', 'D', '6'};
+
+struct MatrixFileHeader
+{
+    char magic[8];
+    GeometryKey key;
+    uint32_t num_rows;
+    uint32_t num_columns;
+    uint64_t num_nonzeros;
+    uint64_t checksum;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 88, "el encabezado debe ocupar 88 bytes");
+static_assert(sizeof(size_t) == sizeof(uint64_t), "col_ptr se guarda como uint64_t");
+
+/* Ocupa 128 bytes para que los datos que le siguen queden alineados 
+ * como los de Matrix y se puedan usar sin copiarlos. */
+struct FactorizationFileHeader
+{
+    char magic[8];
+    GeometryKey key;
+    uint32_t eigen_method;
+    uint32_t max_eigen;
+    double tolerance;
+    uint32_t oversampling;
+    uint32_t power_iterations;
+    uint32_t num_rows;
+    uint32_t num_columns;
+    uint32_t rank;
+    uint32_t reserved;
+    uint64_t checksum;
+    uint64_t padding[3];
+};
+
+static_assert(sizeof(FactorizationFileHeader) == 128, "el encabezado debe ocupar 128 bytes");
+static_assert(sizeof(FactorizationFileHeader) % MATRIX_ALIGNMENT == 0, "los datos deben quedar alineados");
+
+static size_t align8(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t)7;
+}
+
+static const uint64_t checksum_seed = 14695981039346656037ULL;
+
+/* Checksum de un bloque de palabras de 64 bits (los arreglos se 
+ * guardan alineados a 8 bytes, con relleno en cero). */
+static uint64_t checksum(const void* data, size_t bytes, uint64_t h = checksum_seed)
+{
+    const uint64_t* words = (const uint64_t*)data;
+    size_t n = bytes / 8;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ words[i]) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    size_t rest = bytes % 8;
+    if (rest != 0) {
+        uint64_t last = 0;
+        memcpy(&last, (const char*)data + n*8, rest);
+        h = (h ^ last) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+/* El checksum cubre el encabezado (con el campo checksum en cero) y un 
+ * arreglo chico de los datos: col_ptr en la matriz y s en la 
+ * descomposicion. Alcanza para detectar un archivo de otra version o 
+ * escrito a medias (el tamaño ya se compara aparte), y al cargar no 
+ * lee los arreglos grandes, cuyas paginas se traen recien cuando se 
+ * usan: recorrerlos enteros haria perder casi todo lo que se gana al 
+ * mapear el archivo. */
+template <class Header>
+static uint64_t header_checksum(Header header, const void* data, size_t bytes)
+{
+    header.checksum = 0;
+    return checksum(data, bytes, checksum(&header, sizeof(header)));
+}
+
+static bool same_key(const GeometryKey& a, const GeometryKey& b)
+{
+    return a.image_size == b.image_size and a.cell_size == b.cell_size and
+           a.geometry == b.geometry and a.tracer == b.tracer and a.seed == b.seed and
+           a.num_rays == b.num_rays and a.angles == b.angles and a.detectors == b.detectors and
+           a.source_distance == b.source_distance;
+}
+
+/* Parte del nombre de los archivos que identifica a la geometria. */
+static void write_key(stringstream& ss, const GeometryKey& key)
+{
+    ss << key.image_size << "_" << key.cell_size << "_" << key.geometry << "_" << key.num_rays 
+       << "_" << key.angles << "_" << key.detectors << "_" << key.source_distance 
+       << "_" << key.tracer << "_" << key.seed;
+}
+
+string geometry_file(const string& dir, const GeometryKey& key)
+{
+    if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+        return "";
+    }
+    
+    stringstream ss;
+    ss << dir << "/D_";
+    write_key(ss, key);
+    ss << ".bin";
+    return ss.str();
+}
+
+/* Se escribe en un archivo temporal y despues se renombra, para que 
+ * otro proceso nunca vea un archivo a medio escribir. */
+bool save_matrix(const string& filename, const GeometryKey& key, const SparseMatrix& D)
+{
+    if (filename.empty() or !D.is_compressed()) {
+        return false;
+    }
+    
+    size_t nnz = D.num_nonzeros();
+    size_t ptr_bytes = (D.num_columns() + 1) * sizeof(uint64_t);
+    size_t idx_bytes = nnz * sizeof(uint32_t);
+    size_t val_bytes = nnz * sizeof(double);
+    static const char zeros[8] = {0};
+    size_t padding = align8(idx_bytes) - idx_bytes;
+    
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, matrix_magic, sizeof(matrix_magic));
+    header.key = key;
+    header.num_rows = D.num_rows();
+    header.num_columns = D.num_columns();
+    header.num_nonzeros = nnz;
+    header.checksum = header_checksum(header, D.col_ptr(), ptr_bytes);
+    
+    string temp = filename + ".tmp";
+    {
+        ofstream ofile(temp, ios::binary);
+        ofile.write((const char*)&header, sizeof(header));
+        ofile.write((const char*)D.col_ptr(), ptr_bytes);
+        ofile.write((const char*)D.row_indices(), idx_bytes);
+        ofile.write(zeros, padding);
+        ofile.write((const char*)D.values(), val_bytes);
+        if (ofile.fail()) {
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    
+    return rename(temp.c_str(), filename.c_str()) == 0;
+}
+
+shared_ptr<void> map_file(const string& filename, size_t min_size, size_t& file_size, bool writable)
+{
+    if (filename.empty()) {
+        return shared_ptr<void>();
+    }
+    
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return shared_ptr<void>();
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 or (size_t)st.st_size < min_size) {
+        close(fd);
+        return shared_ptr<void>();
+    }
+    size_t size = st.st_size;
+    void* addr = mmap(0, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return shared_ptr<void>();
+    }
+    
+    file_size = size;
+    return shared_ptr<void>(addr, [size](void* p) { munmap(p, size); });
+}
+
+bool load_matrix(const string& filename, const GeometryKey& key, SparseMatrix& D, bool with_rows)
+{
+    size_t file_size;
+    shared_ptr<const void> mapping = map_file(filename, sizeof(MatrixFileHeader), file_size);
+    if (!mapping) {
+        return false;
+    }
+    
+    const char* base = (const char*)mapping.get();
+    const MatrixFileHeader& header = *(const MatrixFileHeader*)base;
+    if (memcmp(header.magic, matrix_magic, sizeof(matrix_magic)) != 0 or !same_key(header.key, key)) {
+        return false;
+    }
+    
+    size_t nnz = header.num_nonzeros;
+    size_t ptr_bytes = (header.num_columns + 1) * sizeof(uint64_t);
+    size_t idx_bytes = align8(nnz * sizeof(uint32_t));
+    size_t val_bytes = nnz * sizeof(double);
+    if (file_size != sizeof(MatrixFileHeader) + ptr_bytes + idx_bytes + val_bytes) {
+        return false;
+    }
+    const size_t* col_ptr = (const size_t*)(base + sizeof(MatrixFileHeader));
+    if (header_checksum(header, col_ptr, ptr_bytes) != header.checksum) {
+        return false;
+    }
+
+    const unsigned* row_idx = (const unsigned*)(base + sizeof(MatrixFileHeader) + ptr_bytes);
+    const double* values = (const double*)(base + sizeof(MatrixFileHeader) + ptr_bytes + idx_bytes);
+    if (col_ptr[header.num_columns] != nnz) {
+        return false;
+    }
+    
+    D = SparseMatrix(header.num_rows, header.num_columns, col_ptr, row_idx, values, mapping, with_rows);
+    return true;
+}
+
+string factorization_file(const string& dir, const GeometryKey& key, const EigenParams& params)
+{
+    if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+        return "";
+    }
+    
+    stringstream ss;
+    ss << dir << "/F_";
+    write_key(ss, key);
+    ss << "_" << params.method << "_" << params.max_eigen << "_" << params.tolerance;
+    if (params.method == RANDOMIZED) {
+        ss << "_" << params.oversampling << "_" << params.power_iterations;
+    }
+    ss << ".bin";
+    return ss.str();
+}
+
+static void fill_header(FactorizationFileHeader& header, const GeometryKey& key, const EigenParams& params)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, factorization_magic, sizeof(factorization_magic));
+    header.key = key;
+    header.eigen_method = params.method;
+    header.max_eigen = params.max_eigen;
+    header.tolerance = params.tolerance;
+    // Igual que en el nombre del archivo, solo cuentan con RANDOMIZED
+    if (params.method == RANDOMIZED) {
+        header.oversampling = params.oversampling;
+        header.power_iterations = params.power_iterations;
+    }
+}
+
+/* Cantidad de elementos de s, U^t y V en el archivo, con cada fila 
+ * completada como en Matrix (y s como si fuera una fila). */
+static size_t factorization_elements(size_t k, size_t m, size_t n)
+{
+    return Matrix::aligned_columns(k) + k * Matrix::aligned_columns(m) + n * Matrix::aligned_columns(k);
+}
+
+/* Escribe la fila completada con ceros hasta ld elementos. */
+static void write_row(ofstream& ofile, const double* row, size_t columns, size_t ld, vector<double>& buffer)
+{
+    buffer.assign(ld, 0.0);
+    copy(row, row + columns, buffer.begin());
+    ofile.write((const char*)buffer.data(), ld * sizeof(double));
+}
+
+/* Despues del encabezado van s (k valores), U^t (k x m) y V (n x k), 
+ * las matrices por filas, con la misma disposicion que en memoria: 
+ * cada fila ocupa un multiplo de MATRIX_ALIGNMENT bytes, completada 
+ * con ceros. Asi al leerlas se pueden usar directamente sobre el 
+ * archivo mapeado. */
+bool save_factorization(const string& filename, const GeometryKey& key, const EigenParams& params, const Factorization& F)
+{
+    if (filename.empty() or F.svalues.empty()) {
+        return false;
+    }
+    
+    unsigned k = F.svalues.size();
+    unsigned m = F.Ut.num_columns();
+    unsigned n = F.V.num_rows();
+    
+    FactorizationFileHeader header;
+    fill_header(header, key, params);
+    header.num_rows = m;
+    header.num_columns = n;
+    header.rank = k;
+    header.checksum = header_checksum(header, F.svalues.data(), k * sizeof(double));
+    
+    string temp = filename + ".tmp";
+    {
+        ofstream ofile(temp, ios::binary);
+        ofile.write((const char*)&header, sizeof(header));
+        vector<double> buffer;
+        write_row(ofile, F.svalues.data(), k, Matrix::aligned_columns(k), buffer);
+        for (unsigned i = 0; i < k; i++) {
+            write_row(ofile, &F.Ut(i,0), m, Matrix::aligned_columns(m), buffer);
+        }
+        for (unsigned i = 0; i < n; i++) {
+            write_row(ofile, &F.V(i,0), k, Matrix::aligned_columns(k), buffer);
+        }
+        if (ofile.fail()) {
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    
+    return rename(temp.c_str(), filename.c_str()) == 0;
+}
+
+/* U^t y V quedan armadas sobre el archivo mapeado, sin copiarlas (el 
+ * mapeo se libera cuando se destruyen las dos). El mapeo admite 
+ * escrituras para que se puedan modificar como cualquier Matrix: solo 
+ * se copian las paginas que se escriben, y el archivo no cambia. */
+bool load_factorization(const string& filename, const GeometryKey& key, const EigenParams& params, Factorization& F)
+{
+    size_t file_size;
+    shared_ptr<void> mapping = map_file(filename, sizeof(FactorizationFileHeader), file_size, true);
+    if (!mapping) {
+        return false;
+    }
+    
+    char* base = (char*)mapping.get();
+    const FactorizationFileHeader& header = *(const FactorizationFileHeader*)base;
+    FactorizationFileHeader expected;
+    fill_header(expected, key, params);
+    if (memcmp(header.magic, expected.magic, sizeof(expected.magic)) != 0 or !same_key(header.key, key) or
+        header.eigen_method != expected.eigen_method or header.max_eigen != expected.max_eigen or
+        header.tolerance != expected.tolerance or header.oversampling != expected.oversampling or
+        header.power_iterations != expected.power_iterations or header.rank == 0) {
+        return false;
+    }
+    
+    size_t k = header.rank, m = header.num_rows, n = header.num_columns;
+    size_t elements = factorization_elements(k, m, n);
+    if (file_size != sizeof(FactorizationFileHeader) + elements * sizeof(double)) {
+        return false;
+    }
+    double* data = (double*)(base + sizeof(FactorizationFileHeader));
+    if (header_checksum(header, data, k * sizeof(double)) != header.checksum) {
+        return false;
+    }
+    
+    F.svalues.assign(data, data + k);
+    data += Matrix::aligned_columns(k);
+    F.Ut = Matrix(k, m, data, mapping);
+    data += k * Matrix::aligned_columns(m);
+    F.V = Matrix(n, k, data, mapping);
+    
+    return true;
+}
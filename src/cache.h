@@ -0,0 +1,72 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+template <class T> class BasicSparseMatrix;
+typedef BasicSparseMatrix<double> SparseMatrix;
+struct EigenParams;
+struct Factorization;
+
+/** Datos de los que depende la matriz D. Para una misma geometria 
+ *  D es siempre la misma, sin importar los valores de los pixeles 
+ *  (que solo afectan a los tiempos). */
+struct GeometryKey
+{
+    uint32_t image_size;
+    uint32_t cell_size;
+    uint32_t geometry;
+    uint32_t tracer;
+    uint64_t seed;
+    uint32_t num_rays;
+    uint32_t angles;
+    uint32_t detectors;
+    uint32_t reserved;
+    double source_distance;
+};
+
+/** Mapea el archivo entero en memoria y deja su tamaño en file_size. 
+ *  Si writable es verdadero el mapeo admite escrituras, pero es 
+ *  privado: cada pagina modificada pasa a ser una copia propia y el 
+ *  archivo nunca cambia; si no, escribir en el es un error. El mapeo 
+ *  se libera cuando se destruye la ultima copia del puntero devuelto, 
+ *  que es nulo si no se pudo mapear o si el archivo es mas chico que 
+ *  min_size. */
+std::shared_ptr<void> map_file(const std::string& filename, size_t min_size, size_t& file_size, bool writable = false);
+
+/** Nombre del archivo correspondiente a la geometria dentro del 
+ *  directorio de cache (que se crea si no existe). */
+std::string geometry_file(const std::string& dir, const GeometryKey& key);
+
+/** Guarda D en formato binario: un encabezado con la geometria, las 
+ *  dimensiones y un checksum (del encabezado y col_ptr, para que cargar 
+ *  no recorra la matriz entera), seguido de los arreglos CSC alineados a 
+ *  8 bytes, de forma que se puedan usar directamente al mapear el 
+ *  archivo. Devuelve falso si no se pudo escribir. */
+bool save_matrix(const std::string& filename, const GeometryKey& key, const SparseMatrix& D);
+
+/** Mapea en memoria un archivo escrito por save_matrix y arma D sobre 
+ *  sus arreglos, sin copiarlos. Devuelve falso (dejando D sin tocar) si 
+ *  el archivo no existe, no corresponde a la geometria o esta dañado. */
+bool load_matrix(const std::string& filename, const GeometryKey& key, SparseMatrix& D, bool with_rows = true);
+
+/** Nombre del archivo de la descomposicion de la D de esta geometria, 
+ *  que tambien depende de los parametros con los que se calcularon 
+ *  los autovalores. */
+std::string factorization_file(const std::string& dir, const GeometryKey& key, const EigenParams& params);
+
+/** Guarda los valores singulares s, U^t y V en formato binario, con un 
+ *  encabezado como el de la matriz D, y las matrices con la misma 
+ *  disposicion (y alineacion) que en memoria. */
+bool save_factorization(const std::string& filename, const GeometryKey& key, const EigenParams& params, const Factorization& F);
+
+/** Mapea en memoria una descomposicion guardada por save_factorization 
+ *  y arma U^t y V sobre el archivo, sin copiarlas. Devuelve falso si no 
+ *  existe, no corresponde a la geometria y los parametros, o esta 
+ *  dañada. */
+bool load_factorization(const std::string& filename, const GeometryKey& key, const EigenParams& params, Factorization& F);
+
+#endif
@@ -66,7 +66,7 @@ inline void print(const SparseMatrix& D, unsigned discr_size, const std::string&
         }
     }
     for (unsigned j = 0; j < cols; j++) {
-        const SparseVector& col = D.get_column(j);
+        SparseVectorView col = D.get_column(j);
         for (unsigned elem = 0; elem < col.size(); elem++) {
             M(col[elem].first, j) = col[elem].second;
         }
@@ -96,7 +96,7 @@ inline void print(const SparseMatrix& D, const std::string& file)
         }
     }
     for (unsigned j = 0; j < cols; j++) {
-        const SparseVector& col = D.get_column(j);
+        SparseVectorView col = D.get_column(j);
         for (unsigned elem = 0; elem < col.size(); elem++) {
             M(col[elem].first, j) = col[elem].second;
         }
@@ -0,0 +1,491 @@
+#include "eigen.h"
+#include "linear_operator.h"
+#include "matrix.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+using namespace std;
+
+static const double epsilon = numeric_limits<double>::epsilon();
+
+// Cada cuantos pasos de Lanczos se revisa la convergencia
+#define LANCZOS_CHECK_INTERVAL 10
+
+// Cada cuantas iteraciones del metodo de la potencia se calcula el error
+#define POWER_CHECK_INTERVAL 25
+
+/* Autovalores de la matriz tridiagonal simetrica con diagonal d y 
+ * subdiagonal e (e[i] acopla i con i+1, e[n-1] no se usa) mediante el 
+ * metodo QL implicito. Los autovalores quedan en d. Cada elemento de z 
+ * es una fila a la que se le aplican las mismas rotaciones que a la 
+ * matriz de autovectores: si z empieza siendo la identidad termina 
+ * teniendo los autovectores por columnas, y si es una sola fila e_k^t 
+ * termina siendo la fila k de esa matriz (que es lo unico que hace 
+ * falta para estimar los residuos de Lanczos). */
+static void tridiagonal_eigen(Vector& d, Vector e, vector<Vector>& z)
+{
+    int n = d.size();
+    if (n == 0) {
+        return;
+    }
+    e[n-1] = 0.0;
+    
+    for (int l = 0; l < n; l++) {
+        unsigned iter = 0;
+        int m;
+        do {
+            for (m = l; m < n - 1; m++) {
+                double dd = fabs(d[m]) + fabs(d[m+1]);
+                if (fabs(e[m]) <= epsilon * dd) {
+                    break;
+                }
+            }
+            if (m != l) {
+                if (iter++ == 60) {
+                    break;
+                }
+                double g = (d[l+1] - d[l]) / (2.0 * e[l]);
+                double r = hypot(g, 1.0);
+                g = d[m] - d[l] + e[l] / (g + (g >= 0.0 ? r : -r));
+                double s = 1.0, c = 1.0, p = 0.0;
+                int i;
+                for (i = m - 1; i >= l; i--) {
+                    double f = s * e[i];
+                    double b = c * e[i];
+                    r = hypot(f, g);
+                    e[i+1] = r;
+                    if (r == 0.0) {
+                        d[i+1] -= p;
+                        e[m] = 0.0;
+                        break;
+                    }
+                    s = f / r;
+                    c = g / r;
+                    g = d[i+1] - p;
+                    r = (d[i] - g) * s + 2.0 * c * b;
+                    p = s * r;
+                    d[i+1] = g + p;
+                    g = c * r - b;
+                    for (unsigned k = 0; k < z.size(); k++) {
+                        f = z[k][i+1];
+                        z[k][i+1] = s * z[k][i] + c * f;
+                        z[k][i] = c * z[k][i] - s * f;
+                    }
+                }
+                if (r == 0.0 and i >= l) {
+                    continue;
+                }
+                d[l] -= p;
+                e[l] = g;
+                e[m] = 0.0;
+            }
+        } while (m != l);
+    }
+}
+
+/* Indices de los autovalores ordenados de mayor a menor. */
+static vector<unsigned> decreasing_order(const Vector& d)
+{
+    vector<unsigned> idx(d.size());
+    for (unsigned i = 0; i < idx.size(); i++) {
+        idx[i] = i;
+    }
+    sort(idx.begin(), idx.end(), [&d](unsigned a, unsigned b) { return d[a] > d[b]; });
+    return idx;
+}
+
+/* Nuevo vector inicial al azar, ortogonal a todos los de la base. 
+ * Devuelve falso si no se pudo obtener uno (la base ya genera todo). */
+static bool random_orthogonal(const vector<Vector>& Q, Vector& q)
+{
+    for (unsigned attempt = 0; attempt < 3; attempt++) {
+        randomize(q);
+        for (unsigned k = 0; k < q.size(); k++) {
+            q[k] -= RAND_MAX / 2.0;
+        }
+        double original_norm = two_norm(q);
+        for (unsigned pass = 0; pass < 2; pass++) {
+            for (unsigned i = 0; i < Q.size(); i++) {
+                double c = inner_product(Q[i], q);
+                for (unsigned k = 0; k < q.size(); k++) {
+                    q[k] -= c * Q[i][k];
+                }
+            }
+        }
+        double norm = two_norm(q);
+        if (norm > 1e-8 * original_norm) {
+            q /= norm;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Un paso del metodo de la potencia: itera con el operador deflacionado 
+ * y mide el error con el operador original. La idea es que queremos 
+ * parar de iterar una vez que el autovector actual 'v' y el autovalor 
+ * actual 'k' cumplan que ||Av - kv|| sea muy chica comparada con ||kv||, 
+ * siendo A el operador original (no el deflacionado) y k = v^t Av. 
+ * Esto va a evitar que al aplicar deflacion se vayan acumulando errores,
+ * y por lo tanto los primeros autovalores/vectores van a ser tan precisos 
+ * como los ultimos. Es mas, gracias a esto podemos ser menos estrictos 
+ * con el máximo error tolerado (params.tolerance), lo cual viene bien para 
+ * el tiempo de ejecucion.
+ *
+ * Un inconveniente es que con esto (segun observaciones) puede pasar que 
+ * no se logre un error menor a params.tolerance nunca, generando que la funcion 
+ * se quede iterando infinitamente. Esto se soluciona viendo si el error 
+ * es igual (con epsilon de C++) al ultimo obtenido, y en ese caso se 
+ * devuelve lo que se tenga hasta ese momento. Al parecer cuando sucede 
+ * esto no es muy grave y en general no vuelve a suceder con las proximas 
+ * llamadas a esta funcion.
+ *
+ * Sin embargo, si detectamos que el error no cambio pero ademas es demasiado 
+ * grande, es decir, mayor a params.fail_tolerance, entonces se concluye que el 
+ * calculo del autovector/valor fallo y por lo tanto la funcion devuelve falso.
+ 
+ * El calculo del error se hace luego de una cantidad fija de iteraciones, 
+ * en vez de hacerlo en todas, para acelerar un poco el proceso. */
+static bool find_main_eigen(const LinearOperator& deflated, const LinearOperator& original, const EigenParams& params, double& eigenval, Vector& eigenvec)
+{
+    unsigned n = original.size();
+    eigenvec /= two_norm(eigenvec);
+    Vector temp(n);
+    double old_squared_error = 999999.0;
+    while (true) {
+        for (unsigned i = 0; i < POWER_CHECK_INTERVAL; i++) {
+            deflated.apply(eigenvec, temp);
+            double norm = two_norm(temp);
+            if (norm == 0.0) {
+                // El vector quedo en el nucleo: no hay mas autovalores 
+                // distintos de cero (por ejemplo, si D es nula)
+                eigenval = 0.0;
+                return false;
+            }
+            eigenvec = temp / norm;
+        }
+        
+        original.apply(eigenvec, temp);
+        eigenval = inner_product(eigenvec, temp);
+        
+        double squared_error = 0.0;
+        for (unsigned i = 0; i < n; i++) {
+            squared_error += (temp[i] - eigenval * eigenvec[i])*(temp[i] - eigenval * eigenvec[i]);
+        }
+        squared_error /= eigenval*eigenval;
+        
+        if (squared_error <= params.tolerance*params.tolerance) {
+            break;
+        }
+        else if (fabs(squared_error - old_squared_error) < epsilon) {
+            if (squared_error <= params.fail_tolerance*params.fail_tolerance) {
+                break;
+            }
+            else {
+                return false;
+            }
+        }
+        else {
+            old_squared_error = squared_error;
+        }
+    }
+    
+    return true;
+}
+
+/* Calcula autovalores y autovectores, termina cuando se hayan 
+ * hallado todos, cuando el calculo de uno de ellos falle, cuando 
+ * un autovalor resulte menor a epsilon o negativo, o cuando un 
+ * autovalor sea mucho mas grande al ultimo calculado. Los pares 
+ * hallados se van deflacionando a traves de un DeflatedOperator, que 
+ * mira directamente evalues y evectors, asi que A nunca se copia y 
+ * cada par agregado solo cuesta O(n) por producto. */
+void power_method(const LinearOperator& A, const EigenParams& params, vector<double>& evalues, vector<Vector>& evectors)
+{
+    unsigned n = A.size();
+    if (params.max_eigen != 0 and params.max_eigen < n) {
+        n = params.max_eigen;
+    }
+    DeflatedOperator deflated(A, evalues, evectors);
+    double eigenval;
+    Vector eigenvec(A.size());
+    for (unsigned k = 0; k < n; k++) {
+        randomize(eigenvec);
+        bool failed = !find_main_eigen(deflated, A, params, eigenval, eigenvec);
+        if ( failed or eigenval < epsilon or (evalues.size() != 0 and evalues.back()/eigenval < 0.1 ) ) {
+            return;
+        }
+
+        evalues.push_back(eigenval);
+        evectors.push_back(eigenvec);
+    }
+}
+
+/* Lanczos con reortogonalizacion completa: se guarda toda la base Q 
+ * y cada nuevo vector se reortogonaliza (dos veces, Gram-Schmidt 
+ * clasico) contra todos los anteriores, lo que evita que aparezcan 
+ * copias espurias de los autovalores ya convergidos.
+ *
+ * Un espacio de Krylov tiene una sola direccion de cada autoespacio 
+ * (la de la proyeccion del vector inicial), asi que una sola 
+ * recurrencia no encuentra los autovalores multiples, que son comunes 
+ * en las geometrias simetricas. Por eso la base se arma por bloques: 
+ * cuando la recurrencia se corta (beta ~ 0, se encontro un subespacio 
+ * invariante) o cuando el bloque activo converge, se empieza otro con 
+ * un vector al azar ortogonal a toda la base. Las demas copias de cada 
+ * autovalor son ortogonales a todos los bloques anteriores, asi que 
+ * aparecen en el nuevo. Se termina cuando un bloque converge sin 
+ * aportar ningun valor entre los pedidos. T queda diagonal por 
+ * bloques (con beta = 0 entre uno y otro).
+ *
+ * La convergencia se revisa solo sobre el bloque activo: los pares de 
+ * los bloques cerrados ya no cambian, y que tengan residuo cero no dice 
+ * nada de las copias que faltan. Se revisa cada LANCZOS_CHECK_INTERVAL 
+ * pasos, una vez que el bloque tiene al menos tantos vectores como 
+ * autovalores pedidos (o todos los que quedan), y cada vez que se 
+ * corta. Se calculan los valores de Ritz del bloque y el residuo de 
+ * cada par, que es |beta_m * s_m,i| con s_m,i la ultima componente del 
+ * autovector i del bloque (cero si se corto). Tienen que haber 
+ * convergido todos los que podrian quedar entre los pedidos, es decir, 
+ * los que tienen theta + residuo mayor o igual al menor de los valores 
+ * de Ritz pedidos (de todos los bloques). Un bloque cortado que no 
+ * aporta nada tambien termina la busqueda: su vector inicial tenia una 
+ * componente en cada autoespacio que faltaba, asi que no queda ningun 
+ * autovalor entre los pedidos. */
+void lanczos(const LinearOperator& A, const EigenParams& params, vector<double>& evalues, vector<Vector>& evectors)
+{
+    unsigned n = A.size();
+    unsigned wanted = (params.max_eigen == 0 or params.max_eigen > n) ? n : params.max_eigen;
+    
+    vector<Vector> Q;
+    Vector alpha, beta;
+    
+    Vector q(n), w(n);
+    if (!random_orthogonal(Q, q)) {
+        return;
+    }
+    
+    double norm_estimate = 0.0;
+    
+    // Primer vector del bloque activo
+    unsigned start = 0;
+    
+    while (true) {
+        Q.push_back(q);
+        unsigned j = Q.size() - 1;
+        
+        A.apply(Q[j], w);
+        alpha.push_back(inner_product(Q[j], w));
+        
+        for (unsigned pass = 0; pass < 2; pass++) {
+            for (unsigned i = 0; i <= j; i++) {
+                double c = inner_product(Q[i], w);
+                for (unsigned k = 0; k < n; k++) {
+                    w[k] -= c * Q[i][k];
+                }
+            }
+        }
+        
+        double b = two_norm(w);
+        norm_estimate = max(norm_estimate, fabs(alpha[j]) + b);
+        bool breakdown = b <= n * epsilon * norm_estimate;
+        
+        unsigned m = Q.size();
+        if (m == n) {
+            beta.push_back(0.0);
+            break;
+        }
+        beta.push_back(breakdown ? 0.0 : b);
+        
+        bool restart = breakdown;
+        unsigned active = m - start;
+        bool check = breakdown or (active >= min(wanted, n - start) and m % LANCZOS_CHECK_INTERVAL == 0);
+        if (m >= wanted and check) {
+            Vector closed(alpha.begin(), alpha.begin() + start);
+            vector<Vector> no_vectors;
+            tridiagonal_eigen(closed, Vector(beta.begin(), beta.begin() + start), no_vectors);
+            
+            Vector d(alpha.begin() + start, alpha.end());
+            vector<Vector> last_row(1, Vector(active, 0.0));
+            last_row[0][active-1] = 1.0;
+            tridiagonal_eigen(d, Vector(beta.begin() + start, beta.end()), last_row);
+            
+            Vector all = closed;
+            all.insert(all.end(), d.begin(), d.end());
+            vector<unsigned> order = decreasing_order(all);
+            double threshold = all[order[wanted-1]];
+            
+            bool converged = true;
+            bool contributes = false;
+            for (unsigned k = 0; k < active and converged; k++) {
+                double theta = d[k];
+                double residual = fabs(beta[m-1] * last_row[0][k]);
+                if (theta + residual >= threshold) {
+                    converged = residual <= params.tolerance * fabs(theta);
+                }
+                contributes = contributes or theta >= threshold;
+            }
+            if (converged and !contributes) {
+                break;
+            }
+            if (converged) {
+                beta[m-1] = 0.0;
+                restart = true;
+            }
+        }
+        
+        if (restart) {
+            start = m;
+            if (!random_orthogonal(Q, q)) {
+                break;
+            }
+        }
+        else {
+            q = w / b;
+        }
+    }
+    
+    // Autovalores y autovectores de T, y vectores de Ritz
+    unsigned m = Q.size();
+    Vector d = alpha;
+    vector<Vector> S(m, Vector(m, 0.0));
+    for (unsigned i = 0; i < m; i++) {
+        S[i][i] = 1.0;
+    }
+    tridiagonal_eigen(d, beta, S);
+    
+    vector<unsigned> idx = decreasing_order(d);
+    double cutoff = max(epsilon, d[idx[0]] * n * epsilon);
+    
+    for (unsigned k = 0; k < wanted and k < m; k++) {
+        double theta = d[idx[k]];
+        if (theta < cutoff) {
+            break;
+        }
+        
+        Vector v(n, 0.0);
+        for (unsigned i = 0; i < m; i++) {
+            double c = S[i][idx[k]];
+            for (unsigned r = 0; r < n; r++) {
+                v[r] += c * Q[i][r];
+            }
+        }
+        v /= two_norm(v);
+        
+        evalues.push_back(theta);
+        evectors.push_back(v);
+    }
+}
+
+/* Reduce A a una tridiagonal T = Q^t A Q con reflexiones de 
+ * Householder (cada una anula una columna debajo de la subdiagonal y 
+ * se aplica de los dos lados como A - 2vw^t - 2wv^t, con w = Av - 
+ * (v^tAv)v), y luego tridiagonal_eigen diagonaliza T aplicandole sus 
+ * rotaciones a las filas de Q, con lo que quedan los autovectores de A 
+ * por columnas. No hay tolerancia: el resultado es exacto salvo por el 
+ * redondeo. Cuesta O(n^3), y es para matrices chicas. */
+void symmetric_eigen(const Matrix& A, unsigned max_eigen, vector<double>& evalues, vector<Vector>& evectors)
+{
+    unsigned n = A.num_rows();
+    unsigned wanted = (max_eigen == 0 or max_eigen > n) ? n : max_eigen;
+    if (n == 0) {
+        return;
+    }
+    
+    vector<Vector> a(n, Vector(n));
+    vector<Vector> Q(n, Vector(n, 0.0));
+    for (unsigned i = 0; i < n; i++) {
+        for (unsigned j = 0; j < n; j++) {
+            a[i][j] = A(i,j);
+        }
+        Q[i][i] = 1.0;
+    }
+    
+    Vector v(n), w(n);
+    for (unsigned k = 0; k + 2 < n; k++) {
+        double norm = 0.0;
+        for (unsigned i = k + 1; i < n; i++) {
+            norm += a[i][k] * a[i][k];
+        }
+        norm = sqrt(norm);
+        if (norm == 0.0) {
+            continue;
+        }
+        
+        // v = x - alpha e_1 normalizado, con alpha del signo opuesto a x_1
+        double alpha = a[k+1][k] > 0.0 ? -norm : norm;
+        for (unsigned i = k + 1; i < n; i++) {
+            v[i] = a[i][k];
+        }
+        v[k+1] -= alpha;
+        double v_norm = 0.0;
+        for (unsigned i = k + 1; i < n; i++) {
+            v_norm += v[i] * v[i];
+        }
+        v_norm = sqrt(v_norm);
+        for (unsigned i = k + 1; i < n; i++) {
+            v[i] /= v_norm;
+        }
+        
+        double vAv = 0.0;
+        for (unsigned i = k + 1; i < n; i++) {
+            w[i] = 0.0;
+            for (unsigned j = k + 1; j < n; j++) {
+                w[i] += a[i][j] * v[j];
+            }
+            vAv += v[i] * w[i];
+        }
+        for (unsigned i = k + 1; i < n; i++) {
+            w[i] -= vAv * v[i];
+        }
+        for (unsigned i = k + 1; i < n; i++) {
+            for (unsigned j = k + 1; j < n; j++) {
+                a[i][j] -= 2.0 * (v[i] * w[j] + w[i] * v[j]);
+            }
+        }
+        a[k+1][k] = a[k][k+1] = alpha;
+        for (unsigned i = k + 2; i < n; i++) {
+            a[i][k] = a[k][i] = 0.0;
+        }
+        
+        // Q = Q H
+        for (unsigned r = 0; r < n; r++) {
+            double c = 0.0;
+            for (unsigned i = k + 1; i < n; i++) {
+                c += Q[r][i] * v[i];
+            }
+            for (unsigned i = k + 1; i < n; i++) {
+                Q[r][i] -= 2.0 * c * v[i];
+            }
+        }
+    }
+    
+    Vector d(n), e(n, 0.0);
+    for (unsigned i = 0; i < n; i++) {
+        d[i] = a[i][i];
+        if (i + 1 < n) {
+            e[i] = a[i+1][i];
+        }
+    }
+    tridiagonal_eigen(d, e, Q);
+    
+    vector<unsigned> idx = decreasing_order(d);
+    double cutoff = max(epsilon, d[idx[0]] * n * epsilon);
+    
+    for (unsigned k = 0; k < wanted; k++) {
+        double theta = d[idx[k]];
+        if (theta < cutoff) {
+            break;
+        }
+        
+        Vector u(n);
+        for (unsigned r = 0; r < n; r++) {
+            u[r] = Q[r][idx[k]];
+        }
+        
+        evalues.push_back(theta);
+        evectors.push_back(u);
+    }
+}
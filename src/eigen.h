@@ -0,0 +1,66 @@
+#ifndef EIGEN_H
+#define EIGEN_H
+
+#include "vector.h"
+
+class LinearOperator;
+class Matrix;
+
+enum EigenMethod {
+    POWER_METHOD,
+    LANCZOS,
+    RANDOMIZED
+};
+
+/** Parametros del calculo de autovalores y autovectores. */
+struct EigenParams
+{
+    EigenMethod method;
+    
+    /** Si es verdadero, D^t*D no se arma y se aplica como D^t*(D*x). 
+     *  RANDOMIZED nunca la arma. */
+    bool matrix_free;
+    
+    /** Cantidad maxima de autovalores a calcular (0 indica todos). */
+    unsigned max_eigen;
+    
+    /** Un par (k, v) se considera convergido cuando 
+     *  ||Av - kv|| <= tolerance * |k|. */
+    double tolerance;
+    
+    /** Con el metodo de la potencia, si el error se estanca por encima 
+     *  de este valor se considera que el calculo fallo. */
+    double fail_tolerance;
+    
+    /** Con RANDOMIZED, cantidad de columnas extra del bosquejo por 
+     *  encima de max_eigen. */
+    unsigned oversampling;
+    
+    /** Con RANDOMIZED, cantidad de iteraciones de potencia (cada una 
+     *  es un producto por D^t y otro por D). */
+    unsigned power_iterations;
+    
+    EigenParams()
+    : method(LANCZOS), matrix_free(false), max_eigen(0), tolerance(0.01), fail_tolerance(0.1),
+      oversampling(10), power_iterations(2) {}
+};
+
+/** Calcula los autovalores mas grandes (y sus autovectores) del 
+ *  operador simetrico semidefinido positivo A con el metodo de Lanczos 
+ *  con reortogonalizacion completa. Los autovalores se devuelven en 
+ *  orden decreciente, descartando los que sean practicamente nulos. */
+void lanczos(const LinearOperator& A, const EigenParams& params, std::vector<double>& evalues, std::vector<Vector>& evectors);
+
+/** Calcula los autovalores mas grandes (y sus autovectores) del 
+ *  operador simetrico A con el metodo de la potencia con deflacion. 
+ *  La deflacion se aplica implicitamente, sin modificar A. */
+void power_method(const LinearOperator& A, const EigenParams& params, std::vector<double>& evalues, std::vector<Vector>& evectors);
+
+/** Calcula los max_eigen autovalores mas grandes (0 indica todos) y 
+ *  sus autovectores de la matriz densa simetrica semidefinida positiva 
+ *  A, tridiagonalizandola y aplicando el metodo QL, sin tolerancia. 
+ *  Los autovalores se devuelven en orden decreciente, descartando los 
+ *  que sean practicamente nulos con el mismo criterio que lanczos. */
+void symmetric_eigen(const Matrix& A, unsigned max_eigen, std::vector<double>& evalues, std::vector<Vector>& evectors);
+
+#endif
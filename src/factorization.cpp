@@ -0,0 +1,265 @@
+#include "factorization.h"
+#include "sparse_matrix.h"
+#include "linear_operator.h"
+#include "metrics.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+// Cantidad de valores de lambda que se prueban en cada grilla de GCV
+#define GCV_LAMBDAS 60
+
+// Menor lambda de la grilla de GCV, relativo al menor valor singular
+#define GCV_RANGE 1e-3
+
+using namespace std;
+
+static void find_eigenpairs(const LinearOperator& AtA, const EigenParams& params, vector<double>& evalues, vector<Vector>& evectors)
+{
+    if (params.method == LANCZOS) {
+        lanczos(AtA, params, evalues, evectors);
+    }
+    else {
+        power_method(AtA, params, evalues, evectors);
+    }
+}
+
+void factorize(const SparseMatrix& A, const EigenParams& params, Factorization& F)
+{
+    if (params.method == RANDOMIZED) {
+        randomized_svd(A, params, F);
+        return;
+    }
+    
+    unsigned m = A.num_rows(); unsigned n = A.num_columns();
+    
+    vector<double> evalues;
+    vector<Vector> evectors;
+    if (params.matrix_free) {
+        find_eigenpairs(NormalOperator(A), params, evalues, evectors);
+    }
+    else {
+        Matrix AtA = A.get_AtA_product();
+        find_eigenpairs(DenseOperator(AtA), params, evalues, evectors);
+    }
+    
+    Vector& svalues = F.svalues;
+    svalues.resize(evalues.size());
+    for (unsigned i = 0; i < svalues.size(); i++) {
+        svalues[i] = sqrt(evalues[i]);
+    }
+
+    F.Ut = Matrix(svalues.size(), m);
+    for (unsigned i = 0; i < svalues.size(); i++) {
+        F.Ut.set_row(i, A*evectors[i] / svalues[i]);
+    }
+
+    F.V = Matrix(n, svalues.size());
+    for (unsigned j = 0; j < svalues.size(); j++) {
+        F.V.set_column(j, evectors[j]);
+    }
+}
+
+/* Numero al azar con distribucion normal estandar (Box-Muller). */
+static double gaussian()
+{
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = rand() / (RAND_MAX + 1.0);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* Ortonormaliza las columnas de Y (Gram-Schmidt clasico, dos pasadas) 
+ * y devuelve la base por filas, Q^t. Las columnas que resultan 
+ * dependientes de las anteriores quedan en cero. */
+static Matrix orthonormal_rows(const Matrix& Y)
+{
+    Matrix Qt = transpose(Y);
+    unsigned l = Qt.num_rows();
+    unsigned dim = Qt.num_columns();
+    Vector c(l);
+    for (unsigned i = 0; i < l; i++) {
+        double* q = &Qt(i,0);
+        double original_norm = sqrt(dot(q, q, dim));
+        for (unsigned pass = 0; pass < 2 and i > 0; pass++) {
+            gemv(Qt.data(), Qt.leading_dimension(), i, dim, q, &c[0]);
+            for (unsigned p = 0; p < i; p++) {
+                axpy(-c[p], &Qt(p,0), q, dim);
+            }
+        }
+        double norm = sqrt(dot(q, q, dim));
+        double scale = norm > 1e-10 * original_norm ? 1.0 / norm : 0.0;
+        for (unsigned k = 0; k < dim; k++) {
+            q[k] *= scale;
+        }
+    }
+    return Qt;
+}
+
+/* Con Omega gaussiana de n x l (l = rango pedido mas el sobremuestreo), 
+ * Q es una base ortonormal de D*Omega, mejorada con q iteraciones de 
+ * potencia (D*D^t)^q, que separan mejor los valores singulares grandes 
+ * de los chicos. Luego con Z = D^t*Q (que es B^t, con B = Q^t*D de l x n) 
+ * la matriz chica B*B^t = Z^t*Z = W*S^2*W^t da los valores singulares, 
+ * U = Q*W y V = Z*W*S^-1. Cada paso sobre D es un producto por un bloque 
+ * de l vectores, asi que el costo es O(nnz*l) mas O((m+n)*l^2), sin 
+ * armar nunca D^t*D. B*B^t se diagonaliza con symmetric_eigen, que es 
+ * exacta salvo por el redondeo (Lanczos cortaria con su tolerancia), 
+ * y descarta los autovalores menores a l * epsilon veces el mayor: los 
+ * valores singulares que quedan son al menos sqrt(l * epsilon) veces 
+ * el mayor, asi que S^-1 nunca divide por uno practicamente nulo. */
+void randomized_svd(const SparseMatrix& A, const EigenParams& params, Factorization& F)
+{
+    unsigned m = A.num_rows(); unsigned n = A.num_columns();
+    unsigned max_rank = min(m, n);
+    unsigned wanted = (params.max_eigen == 0 or params.max_eigen > max_rank) ? max_rank : params.max_eigen;
+    unsigned l = min(max_rank, wanted + params.oversampling);
+    
+    Matrix Omega(n, l);
+    for (unsigned i = 0; i < n; i++) {
+        for (unsigned j = 0; j < l; j++) {
+            Omega(i,j) = gaussian();
+        }
+    }
+    
+    Matrix Qt = orthonormal_rows(A*Omega);
+    for (unsigned q = 0; q < params.power_iterations; q++) {
+        Matrix Pt = orthonormal_rows(transposed_product(A, transpose(Qt)));
+        Qt = orthonormal_rows(A*transpose(Pt));
+    }
+    Matrix Z = transposed_product(A, transpose(Qt));
+    Matrix BBt = transpose(Z)*Z;
+    
+    vector<double> evalues;
+    vector<Vector> evectors;
+    symmetric_eigen(BBt, wanted, evalues, evectors);
+    
+    unsigned k = evalues.size();
+    F.svalues.resize(k);
+    Matrix Wt(k, l);
+    Matrix WSinv(l, k);
+    for (unsigned i = 0; i < k; i++) {
+        F.svalues[i] = sqrt(evalues[i]);
+        for (unsigned c = 0; c < l; c++) {
+            Wt(i,c) = evectors[i][c];
+            WSinv(c,i) = evectors[i][c] / F.svalues[i];
+        }
+    }
+    F.Ut = Wt*Qt;
+    F.V = Z*WSinv;
+}
+
+/* Funcion de validacion cruzada generalizada para c = U^t*b:
+ * GCV(lambda) = ||b - Ax||^2 / (m - sum_i f_i)^2, con f_i = s^2/(s^2 + lambda^2). 
+ * El residuo tiene la parte de b fuera de la imagen de U, que no depende 
+ * de lambda (outside = ||b||^2 - ||c||^2), mas sum_i ((1 - f_i) c_i)^2, 
+ * asi que cada evaluacion cuesta O(k). */
+static double gcv(const Vector& svalues, const Vector& c, double outside, unsigned m, double lambda)
+{
+    double residual = outside;
+    double trace = 0.0;
+    for (unsigned i = 0; i < svalues.size(); i++) {
+        double s2 = svalues[i] * svalues[i];
+        double f = s2 / (s2 + lambda * lambda);
+        residual += (1.0 - f) * (1.0 - f) * c[i] * c[i];
+        trace += f;
+    }
+    double dof = m - trace;
+    return dof > 0.0 ? residual / (dof * dof) : numeric_limits<double>::infinity();
+}
+
+/* Se prueban GCV_LAMBDAS valores de lambda espaciados logaritmicamente 
+ * entre el mayor valor singular y GCV_RANGE veces el menor, y se 
+ * refina alrededor del mejor con una segunda grilla igual de fina. 
+ * Necesita al menos un valor singular. */
+static double choose_lambda(const Vector& svalues, const Vector& c, double b_norm2, unsigned m)
+{
+    double outside = max(0.0, b_norm2 - squared_two_norm(c));
+    double hi = log(svalues[0]);
+    double lo = log(svalues.back() * GCV_RANGE);
+    
+    double best = 0.0;
+    double best_value = gcv(svalues, c, outside, m, 0.0);
+    for (unsigned pass = 0; pass < 2; pass++) {
+        double step = (hi - lo) / (GCV_LAMBDAS - 1);
+        for (unsigned t = 0; t < GCV_LAMBDAS; t++) {
+            double lambda = exp(lo + t * step);
+            double value = gcv(svalues, c, outside, m, lambda);
+            if (value < best_value) {
+                best_value = value;
+                best = lambda;
+            }
+        }
+        if (best == 0.0) {
+            break;
+        }
+        lo = log(best) - step;
+        hi = log(best) + step;
+    }
+    return best;
+}
+
+/* Todos los b se apilan como columnas de una matriz B, y se calculan 
+ * C = U^t*B y X = V*(F*S^-1*C) con productos de matrices, siendo F los 
+ * factores de Tikhonov s^2/(s^2 + lambda^2). Asi U^t y V se leen de 
+ * memoria una sola vez en total, en lugar de una vez por cada nivel de 
+ * ruido, y elegir lambda solo cuesta operaciones sobre las columnas de C. 
+ * Si la descomposicion quedo vacia (D nula, o todos los valores 
+ * singulares por debajo de la tolerancia) la solucion es cero. */
+vector<Vector> solve(const Factorization& F, const vector<Vector>& bs, const Regularization& reg, Metrics& metrics)
+{
+    const Vector& svalues = F.svalues;
+    unsigned m = F.Ut.num_columns();
+    unsigned k = svalues.size();
+    unsigned r = bs.size();
+    
+    metrics.lambdas.assign(r, reg.lambda);
+    if (k == 0) {
+        metrics.cond_number = 0.0;
+        metrics.num_eigen_found = 0;
+        return vector<Vector>(r, Vector(F.V.num_rows(), 0.0));
+    }
+    
+    Matrix B(m, r);
+    for (unsigned p = 0; p < m; p++) {
+        for (unsigned j = 0; j < r; j++) {
+            B(p,j) = bs[j][p];
+        }
+    }
+    
+    Matrix C = F.Ut*B;
+    
+    if (reg.automatic) {
+        for (unsigned j = 0; j < r; j++) {
+            Vector c(k);
+            for (unsigned i = 0; i < k; i++) {
+                c[i] = C(i,j);
+            }
+            metrics.lambdas[j] = choose_lambda(svalues, c, squared_two_norm(bs[j]), m);
+        }
+    }
+    
+    for (unsigned i = 0; i < k; i++) {
+        double s2 = svalues[i] * svalues[i];
+        for (unsigned j = 0; j < r; j++) {
+            double lambda = metrics.lambdas[j];
+            C(i,j) *= svalues[i] / (s2 + lambda * lambda);
+        }
+    }
+    
+    Matrix X = F.V*C;
+    
+    vector<Vector> results(r, Vector(X.num_rows()));
+    for (unsigned i = 0; i < X.num_rows(); i++) {
+        for (unsigned j = 0; j < r; j++) {
+            results[j][i] = X(i,j);
+        }
+    }
+
+    // Los autovalores de D^t*D son los cuadrados de los valores singulares
+    metrics.cond_number = (svalues[0] * svalues[0]) / (svalues.back() * svalues.back());
+    metrics.num_eigen_found = svalues.size();
+    
+    return results;
+}
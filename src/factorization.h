@@ -0,0 +1,54 @@
+#ifndef FACTORIZATION_H
+#define FACTORIZATION_H
+
+#include "vector.h"
+#include "matrix.h"
+
+template <class T> class BasicSparseMatrix;
+typedef BasicSparseMatrix<double> SparseMatrix;
+struct EigenParams;
+struct Metrics;
+
+/** Descomposicion en valores singulares truncada D ~ U*S*V^t, a partir 
+ *  de la cual la solucion de cuadrados minimos es x = V*S^-1*U^t*b. 
+ *  Solo depende de D, asi que sirve para cualquier b. */
+struct Factorization
+{
+    Vector svalues;
+    Matrix Ut;
+    Matrix V;
+};
+
+/** Regularizacion de Tikhonov de la solucion: en lugar de dividir cada 
+ *  componente por s, se la multiplica por s/(s^2 + lambda^2), lo que 
+ *  equivale a resolver min ||Ax - b||^2 + lambda^2 ||x||^2. Con 
+ *  lambda = 0 es la solucion de cuadrados minimos usual. */
+struct Regularization
+{
+    /** Si es verdadero, lambda se elige para cada b por separado, 
+     *  minimizando la validacion cruzada generalizada (GCV). */
+    bool automatic;
+    
+    double lambda;
+    
+    Regularization()
+    : automatic(false), lambda(0.0) {}
+};
+
+/** Calcula la descomposicion a partir de los autovalores y autovectores 
+ *  de D^t*D, o con randomized_svd si params.method es RANDOMIZED. */
+void factorize(const SparseMatrix& A, const EigenParams& params, Factorization& F);
+
+/** Descomposicion truncada aleatorizada (Halko, Martinsson y Tropp): 
+ *  se obtiene una base de la imagen de D con unos pocos productos por 
+ *  bloques de vectores, y la descomposicion sale de una matriz chica. 
+ *  Calcula a lo sumo params.max_eigen valores singulares. */
+void randomized_svd(const SparseMatrix& A, const EigenParams& params, Factorization& F);
+
+/** Resuelve cuadrados minimos para cada b de bs usando la descomposicion 
+ *  (c = U^t*b, y = c/s, x = V*y), con la regularizacion pedida. Completa 
+ *  el numero de condicion, la cantidad de autovalores y los lambda 
+ *  usados de metrics. */
+std::vector<Vector> solve(const Factorization& F, const std::vector<Vector>& bs, const Regularization& reg, Metrics& metrics);
+
+#endif
@@ -0,0 +1,307 @@
+#include "fbp.h"
+#include "metrics.h"
+#include "parallel.h"
+#include <chrono>
+#include <cmath>
+#include <complex>
+
+using namespace std;
+
+typedef complex<double> Complex;
+
+/* FFT iterativa radix-2 (Cooley-Tukey) sobre a, cuyo tamaño tiene que 
+ * ser potencia de dos. Con inverse calcula la transformada inversa, 
+ * ya dividida por el tamaño. */
+static void fft(vector<Complex>& a, bool inverse)
+{
+    unsigned n = a.size();
+    for (unsigned i = 1, j = 0; i < n; i++) {
+        unsigned bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            swap(a[i], a[j]);
+        }
+    }
+    for (unsigned len = 2; len <= n; len <<= 1) {
+        double angle = 2.0 * M_PI / len * (inverse ? 1.0 : -1.0);
+        Complex step(cos(angle), sin(angle));
+        for (unsigned i = 0; i < n; i += len) {
+            Complex w(1.0, 0.0);
+            for (unsigned k = 0; k < len / 2; k++) {
+                Complex u = a[i+k];
+                Complex v = a[i+k+len/2] * w;
+                a[i+k] = u + v;
+                a[i+k+len/2] = u - v;
+                w *= step;
+            }
+        }
+    }
+    if (inverse) {
+        for (unsigned i = 0; i < n; i++) {
+            a[i] /= n;
+        }
+    }
+}
+
+/* Respuesta en frecuencia del filtro, para convoluciones de tamaño 
+ * size. Se parte del filtro rampa discreto en el espacio (Ram-Lak, con 
+ * h[0] = 1/4, h[n] = -1/(pi n)^2 para n impar y 0 para n par), que a 
+ * diferencia de muestrear |w| directamente no deja un error constante 
+ * en la imagen. Shepp-Logan lo multiplica ademas por sinc(f), lo que 
+ * atenua las frecuencias altas (y con ellas el ruido). */
+static vector<Complex> filter_response(unsigned size, FbpFilter filter)
+{
+    vector<Complex> h(size, 0.0);
+    h[0] = 0.25;
+    for (unsigned n = 1; n < size / 2; n += 2) {
+        double value = -1.0 / (M_PI * M_PI * n * n);
+        h[n] = value;
+        h[size - n] = value;
+    }
+    fft(h, false);
+    
+    if (filter == SHEPP_LOGAN) {
+        for (unsigned k = 1; k < size; k++) {
+            double f = (k <= size / 2 ? (double)k : (double)k - size) / size;
+            h[k] *= sin(M_PI * f) / (M_PI * f);
+        }
+    }
+    return h;
+}
+
+/* Sinograma de angles x bins: la fila k corresponde al angulo 
+ * phi_k = k*pi/angles de la normal a las rectas, y la columna s a la 
+ * distancia con signo s - (bins-1)/2 entre la recta y el centro de la 
+ * imagen. */
+struct Sinogram
+{
+    unsigned angles;
+    unsigned bins;
+    vector<Vector> rows;
+};
+
+/* Cada recta cae en el angulo mas cercano y se reparte linealmente 
+ * entre las dos distancias vecinas; cada casillero se queda con el 
+ * promedio pesado. Los casilleros sin datos cuya recta no corta la 
+ * imagen valen cero. El resto se completa interpolando: primero a lo 
+ * largo de la fila, entre los casilleros con datos, y despues lo que 
+ * quede (en el metodo 0 faltan las rectas cerca de 45 y 135 grados que 
+ * van entre lados contiguos, que son las que pasan cerca de las 
+ * esquinas) entre los angulos mas cercanos que tengan esa distancia. 
+ * Al pasar de pi a 0 la normal se invierte, asi que la distancia s del 
+ * angulo k + angles es la -s del angulo k. */
+static Sinogram rebin(unsigned image_size, const vector<Line>& lines, const Vector& p)
+{
+    Sinogram sino;
+    sino.angles = 2 * image_size;
+    sino.bins = (unsigned)ceil(image_size * sqrt(2.0)) + 3;
+    sino.rows.assign(sino.angles, Vector(sino.bins, 0.0));
+    vector<Vector> weights(sino.angles, Vector(sino.bins, 0.0));
+    
+    double center = image_size / 2.0;
+    double origin = (sino.bins - 1) / 2.0;
+    for (unsigned r = 0; r < lines.size(); r++) {
+        const Line& line = lines[r];
+        double dx = line.x1 - line.x0;
+        double dy = line.y1 - line.y0;
+        double length = sqrt(dx*dx + dy*dy);
+        if (length == 0.0) {
+            continue;
+        }
+        double nx = -dy / length;
+        double ny = dx / length;
+        double phi = atan2(ny, nx);
+        double s = nx * (line.x0 - center) + ny * (line.y0 - center);
+        if (phi < 0.0) {
+            phi += M_PI;
+            s = -s;
+        }
+        
+        double angle_pos = phi / M_PI * sino.angles + 0.5;
+        unsigned k = (unsigned)floor(angle_pos);
+        if (k >= sino.angles) {
+            k -= sino.angles;
+            s = -s;
+        }
+        double pos = s + origin;
+        int b = (int)floor(pos);
+        double frac = pos - b;
+        if (b >= 0 and b < (int)sino.bins) {
+            sino.rows[k][b] += (1.0 - frac) * p[r];
+            weights[k][b] += 1.0 - frac;
+        }
+        if (b + 1 >= 0 and b + 1 < (int)sino.bins) {
+            sino.rows[k][b+1] += frac * p[r];
+            weights[k][b+1] += frac;
+        }
+    }
+    
+    // 0: la recta no corta la imagen, 1: hay datos, 2: falta completarlo
+    vector<vector<unsigned char> > state(sino.angles, vector<unsigned char>(sino.bins, 0));
+    for (unsigned k = 0; k < sino.angles; k++) {
+        double phi = M_PI * k / sino.angles;
+        double reach = center * (fabs(cos(phi)) + fabs(sin(phi)));
+        Vector& row = sino.rows[k];
+        int last = -1;
+        for (unsigned b = 0; b < sino.bins; b++) {
+            if (weights[k][b] > 1e-9) {
+                row[b] /= weights[k][b];
+                state[k][b] = 1;
+                for (int g = last + 1; last >= 0 and g < (int)b; g++) {
+                    double t = (double)(g - last) / (b - last);
+                    row[g] = (1.0 - t) * row[last] + t * row[b];
+                    state[k][g] = 1;
+                }
+                last = b;
+            }
+        }
+        for (unsigned b = 0; b < sino.bins; b++) {
+            if (state[k][b] == 0 and fabs(b - origin) < reach) {
+                state[k][b] = 2;
+            }
+        }
+    }
+    
+    unsigned n = sino.angles;
+    for (unsigned b = 0; b < sino.bins; b++) {
+        unsigned mirror = sino.bins - 1 - b;
+        for (unsigned k = 0; k < n; k++) {
+            if (state[k][b] != 2) {
+                continue;
+            }
+            // Angulo con datos mas cercano hacia cada lado, dando la vuelta
+            double below = 0.0, above = 0.0;
+            unsigned dist_below = 0, dist_above = 0;
+            for (unsigned d = 1; d < n and dist_below == 0; d++) {
+                unsigned kk = (k + n - d) % n;
+                unsigned bb = k >= d ? b : mirror;
+                if (state[kk][bb] == 1) {
+                    below = sino.rows[kk][bb];
+                    dist_below = d;
+                }
+            }
+            for (unsigned d = 1; d < n and dist_above == 0; d++) {
+                unsigned kk = (k + d) % n;
+                unsigned bb = k + d < n ? b : mirror;
+                if (state[kk][bb] == 1) {
+                    above = sino.rows[kk][bb];
+                    dist_above = d;
+                }
+            }
+            if (dist_below != 0 and dist_above != 0) {
+                double t = (double)dist_below / (dist_below + dist_above);
+                sino.rows[k][b] = (1.0 - t) * below + t * above;
+            }
+            else {
+                sino.rows[k][b] = dist_below != 0 ? below : above;
+            }
+        }
+    }
+    
+    return sino;
+}
+
+/* Convolucion de cada fila con el filtro, rellenando con ceros hasta 
+ * una potencia de dos de al menos el doble del largo de la fila para 
+ * que la convolucion circular no mezcle los extremos. */
+static void filter_rows(Sinogram& sino, FbpFilter filter)
+{
+    unsigned size = 1;
+    while (size < 2 * sino.bins) {
+        size <<= 1;
+    }
+    vector<Complex> response = filter_response(size, filter);
+    
+    parallel_for(sino.angles, [&](unsigned, unsigned begin, unsigned end) {
+        vector<Complex> a(size);
+        for (unsigned k = begin; k < end; k++) {
+            Vector& row = sino.rows[k];
+            for (unsigned b = 0; b < size; b++) {
+                a[b] = b < sino.bins ? row[b] : 0.0;
+            }
+            fft(a, false);
+            for (unsigned b = 0; b < size; b++) {
+                a[b] *= response[b];
+            }
+            fft(a, true);
+            for (unsigned b = 0; b < sino.bins; b++) {
+                row[b] = a[b].real();
+            }
+        }
+    });
+}
+
+/* f(x,y) = pi/angles * sum_k q_k(x cos phi_k + y sin phi_k), evaluada 
+ * en el centro de cada pixel con interpolacion lineal en s. Las filas 
+ * de la imagen se reparten entre los hilos. */
+static vector<Vector> back_project(unsigned image_size, const Sinogram& sino)
+{
+    vector<Vector> image(image_size, Vector(image_size, 0.0));
+    Vector cosines(sino.angles), sines(sino.angles);
+    for (unsigned k = 0; k < sino.angles; k++) {
+        cosines[k] = cos(M_PI * k / sino.angles);
+        sines[k] = sin(M_PI * k / sino.angles);
+    }
+    
+    double center = image_size / 2.0;
+    double origin = (sino.bins - 1) / 2.0;
+    double scale = M_PI / sino.angles;
+    parallel_for(image_size, [&](unsigned, unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+            double y = i + 0.5 - center;
+            for (unsigned j = 0; j < image_size; j++) {
+                double x = j + 0.5 - center;
+                double sum = 0.0;
+                for (unsigned k = 0; k < sino.angles; k++) {
+                    double pos = x * cosines[k] + y * sines[k] + origin;
+                    int b = (int)floor(pos);
+                    if (b < 0 or b + 1 >= (int)sino.bins) {
+                        continue;
+                    }
+                    double frac = pos - b;
+                    sum += (1.0 - frac) * sino.rows[k][b] + frac * sino.rows[k][b+1];
+                }
+                image[i][j] = scale * sum;
+            }
+        }
+    });
+    return image;
+}
+
+vector<Vector> fbp(unsigned image_size, unsigned cell_size, const vector<Line>& lines, const vector<Vector>& ps, FbpFilter filter, Metrics& metrics)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    unsigned discr_size = (image_size + cell_size - 1) / cell_size;
+    vector<Vector> results(ps.size(), Vector(discr_size * discr_size, 0.0));
+    
+    for (unsigned k = 0; k < ps.size(); k++) {
+        Sinogram sino = rebin(image_size, lines, ps[k]);
+        filter_rows(sino, filter);
+        vector<Vector> image = back_project(image_size, sino);
+        
+        // Promedio de cada celda
+        Vector& x = results[k];
+        Vector count(x.size(), 0.0);
+        for (unsigned i = 0; i < image_size; i++) {
+            for (unsigned j = 0; j < image_size; j++) {
+                unsigned cell = (i / cell_size) * discr_size + j / cell_size;
+                x[cell] += image[i][j];
+                count[cell] += 1.0;
+            }
+        }
+        for (unsigned c = 0; c < x.size(); c++) {
+            x[c] /= count[c];
+        }
+    }
+    
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    metrics.cond_number = 0.0;
+    metrics.num_eigen_found = 0;
+    metrics.num_iterations = 0;
+    
+    return results;
+}
@@ -0,0 +1,24 @@
+#ifndef FBP_H
+#define FBP_H
+
+#include "vector.h"
+#include "geometry.h"
+
+struct Metrics;
+
+enum FbpFilter {
+    RAM_LAK,
+    SHEPP_LOGAN
+};
+
+/** Reconstruccion por retroproyeccion filtrada. Para cada vector de 
+ *  integrales de linea de ps (ps[k][r] es la integral de la imagen 
+ *  sobre lines[r]) reagrupa las rectas en un sinograma de haces 
+ *  paralelos, filtra cada angulo con el filtro pedido (con una FFT 
+ *  propia) y retroproyecta. Devuelve, como los demas metodos, el valor 
+ *  promedio de cada celda de cell_size x cell_size pixeles. Las rectas 
+ *  tienen que cubrir todos los angulos, como las del metodo 0 o las de 
+ *  los tomografos de haces paralelos y en abanico. */
+std::vector<Vector> fbp(unsigned image_size, unsigned cell_size, const std::vector<Line>& lines, const std::vector<Vector>& ps, FbpFilter filter, Metrics& metrics);
+
+#endif
@@ -0,0 +1,350 @@
+#include "geometry.h"
+#include "random.h"
+#include <cmath>
+
+using namespace std;
+
+void PixelGeometry::rays(unsigned begin, unsigned end, vector<Ray>& batch) const
+{
+    batch.clear();
+    for (unsigned r = begin; r < end; r++) {
+        batch.push_back(ray(r));
+    }
+}
+
+void PixelGeometry::lines(unsigned begin, unsigned end, vector<Line>& batch) const
+{
+    batch.clear();
+    for (unsigned r = begin; r < end; r++) {
+        Ray ray = this->ray(r);
+        batch.push_back(Line(ray.x0 + 0.5, ray.y0 + 0.5, ray.x1 + 0.5, ray.y1 + 0.5));
+    }
+}
+
+enum Direction {
+    UP_LEFT,
+    UP_RIGHT,
+    DOWN_LEFT,
+    DOWN_RIGHT
+};
+
+/* Esto es para generar un rayo diagonal de pendiente 1 sin
+ * complicarse la vida.
+ * Hace "trampa" porque el segundo pixel no va a estar en el borde
+ * de la imagen, pero funciona. */
+static Ray diagonal_ray(unsigned x0, unsigned y0, Direction dir)
+{
+    switch (dir) {
+    case UP_LEFT:
+        return Ray(x0, y0, x0 - 1, y0 - 1);
+    case UP_RIGHT:
+        return Ray(x0, y0, x0 + 1, y0 - 1);
+    case DOWN_LEFT:
+        return Ray(x0, y0, x0 - 1, y0 + 1);
+    default: // DOWN_RIGHT
+        return Ray(x0, y0, x0 + 1, y0 + 1);
+    }
+}
+
+/* Metodo 0: todos los posibles rayos que partan de un lado y lleguen
+ * al lado opuesto, primero de izquierda a derecha y despues de arriba
+ * hacia abajo. */
+class FullGeometry : public PixelGeometry
+{
+
+public:
+
+    FullGeometry(unsigned image_size) : _n(image_size) {}
+    
+    unsigned num_rays() const {
+        return 2 * _n * _n;
+    }
+    
+    Ray ray(unsigned r) const {
+        if (r < _n * _n) {
+            return Ray(0, r / _n, _n - 1, r % _n);
+        }
+        r -= _n * _n;
+        return Ray(r / _n, 0, r % _n, _n - 1);
+    }
+    
+private:
+
+    unsigned _n;
+
+};
+
+/* Metodo 1: rayos horizontales, verticales y diagonales de pendiente
+ * uno, en ese orden. */
+class AxisGeometry : public PixelGeometry
+{
+
+public:
+
+    AxisGeometry(unsigned image_size) : _n(image_size) {}
+    
+    unsigned num_rays() const {
+        return 6 * _n - 6;
+    }
+    
+    Ray ray(unsigned r) const {
+        if (r < _n) {
+            return Ray(0, r, _n - 1, r);
+        }
+        r -= _n;
+        if (r < _n) {
+            return Ray(r, 0, r, _n - 1);
+        }
+        r -= _n;
+        if (r < _n - 1) {
+            return diagonal_ray(0, r, DOWN_RIGHT);
+        }
+        r -= _n - 1;
+        if (r < _n - 2) {
+            return diagonal_ray(r + 1, 0, DOWN_RIGHT);
+        }
+        r -= _n - 2;
+        if (r < _n - 1) {
+            return diagonal_ray(0, r + 1, UP_RIGHT);
+        }
+        r -= _n - 1;
+        return diagonal_ray(r + 1, _n - 1, UP_RIGHT);
+    }
+    
+private:
+
+    unsigned _n;
+
+};
+
+/* Metodo 2: desde cada una de las cuatro esquinas se barre toda la
+ * imagen con 2n - 1 rayos, hasta cada pixel de los dos lados opuestos
+ * a la esquina. */
+class CornerGeometry : public PixelGeometry
+{
+
+public:
+
+    CornerGeometry(unsigned image_size) : _n(image_size) {}
+    
+    unsigned num_rays() const {
+        return 4 * (2 * _n - 1);
+    }
+    
+    Ray ray(unsigned r) const {
+        unsigned n = _n;
+        unsigned corner = r / (2 * n - 1);
+        unsigned k = r % (2 * n - 1);
+        switch (corner) {
+        case 0:
+            return k < n ? Ray(0, 0, n - 1, k) : Ray(0, 0, k - n, n - 1);
+        case 1:
+            return k < n ? Ray(n - 1, 0, 0, k) : Ray(n - 1, 0, k - n + 1, n - 1);
+        case 2:
+            return k < n ? Ray(0, n - 1, n - 1, k) : Ray(0, n - 1, k - n, 0);
+        default:
+            return k < n ? Ray(n - 1, n - 1, 0, k) : Ray(n - 1, n - 1, k - n + 1, 0);
+        }
+    }
+    
+private:
+
+    unsigned _n;
+
+};
+
+/* Rayos aleatorios entre dos lados de la imagen. Los numeros de cada
+ * rayo salen del generador basado en contador, con el indice del rayo
+ * como contador, asi que los rayos dependen solo de la semilla. */
+class RandomGeometry : public PixelGeometry
+{
+
+public:
+
+    RandomGeometry(unsigned image_size, unsigned num_rays, uint64_t seed)
+    : _n(image_size), _num_rays(num_rays), _seed(seed) {}
+    
+    unsigned num_rays() const {
+        return _num_rays;
+    }
+    
+    Ray ray(unsigned i) const {
+        unsigned n = _n;
+        double u[4];
+        random_uniform4(_seed, i, 0, RAY_STREAM, u);
+        unsigned r0 = (unsigned)(u[0] * 6);
+        unsigned r1 = (unsigned)(u[1] * n);
+        unsigned r2 = (unsigned)(u[2] * n);
+        if (r0 == 0) {
+            return Ray(0, r1, n - 1, r2);
+        }
+        else if (r0 == 1) {
+            return Ray(r1, 0, r2, n - 1);
+        }
+        else if (r0 == 2) {
+            return Ray(0, r1, r2, 0);
+        }
+        else if (r0 == 3) {
+            return Ray(r1, 0, n - 1, r2);
+        }
+        else if (r0 == 4) {
+            return Ray(n - 1, r1, r2, n - 1);
+        }
+        else {
+            return Ray(r1, n - 1, 0, r2);
+        }
+    }
+    
+private:
+
+    unsigned _n;
+    unsigned _num_rays;
+    uint64_t _seed;
+
+};
+
+/* Tomografo de haces paralelos: para cada uno de los angulos
+ * theta_k = k*pi/angles, un haz de rayos paralelos de direccion
+ * (cos theta_k, sin theta_k), uno por detector, con los detectores
+ * equiespaciados sobre la diagonal de la imagen (asi el haz cubre la
+ * imagen en todos los angulos). Los rayos de un mismo angulo son
+ * consecutivos, como las lecturas de una proyeccion. */
+class ParallelBeamGeometry : public Geometry
+{
+
+public:
+
+    ParallelBeamGeometry(unsigned image_size, unsigned angles, unsigned detectors)
+    : _n(image_size), _detectors(detectors), _cos(angles), _sin(angles)
+    {
+        for (unsigned k = 0; k < angles; k++) {
+            double theta = M_PI * k / angles;
+            _cos[k] = cos(theta);
+            _sin[k] = sin(theta);
+        }
+    }
+    
+    unsigned num_rays() const {
+        return _cos.size() * _detectors;
+    }
+    
+    void lines(unsigned begin, unsigned end, vector<Line>& batch) const {
+        double center = _n / 2.0;
+        double spacing = _n * sqrt(2.0) / _detectors;
+        double reach = _n;
+        batch.clear();
+        for (unsigned r = begin; r < end; r++) {
+            unsigned k = r / _detectors;
+            unsigned j = r % _detectors;
+            double s = (j + 0.5 - _detectors / 2.0) * spacing;
+            double dx = _cos[k], dy = _sin[k];
+            double px = center - s * dy;
+            double py = center + s * dx;
+            batch.push_back(Line(px - reach * dx, py - reach * dy, px + reach * dx, py + reach * dy));
+        }
+    }
+    
+private:
+
+    unsigned _n;
+    unsigned _detectors;
+    vector<double> _cos;
+    vector<double> _sin;
+
+};
+
+/* Tomografo de haz en abanico: la fuente da una vuelta completa
+ * alrededor de la imagen, a distancia source_distance del centro, y
+ * en cada una de sus angles posiciones emite un rayo por detector. Los
+ * detectores son equiangulares y el abanico abarca justo el circulo
+ * que contiene a la imagen. */
+class FanBeamGeometry : public Geometry
+{
+
+public:
+
+    FanBeamGeometry(unsigned image_size, unsigned angles, unsigned detectors, double source_distance)
+    : _n(image_size), _distance(source_distance), _cos_source(angles), _sin_source(angles), _cos_fan(detectors), _sin_fan(detectors)
+    {
+        for (unsigned k = 0; k < angles; k++) {
+            double beta = 2.0 * M_PI * k / angles;
+            _cos_source[k] = cos(beta);
+            _sin_source[k] = sin(beta);
+        }
+        
+        double half_fan = asin(min(1.0, image_size / sqrt(2.0) / source_distance));
+        for (unsigned j = 0; j < detectors; j++) {
+            double gamma = (j + 0.5 - detectors / 2.0) * (2.0 * half_fan / detectors);
+            _cos_fan[j] = cos(gamma);
+            _sin_fan[j] = sin(gamma);
+        }
+    }
+    
+    unsigned num_rays() const {
+        return _cos_source.size() * _cos_fan.size();
+    }
+    
+    void lines(unsigned begin, unsigned end, vector<Line>& batch) const {
+        double center = _n / 2.0;
+        unsigned detectors = _cos_fan.size();
+        batch.clear();
+        for (unsigned r = begin; r < end; r++) {
+            unsigned k = r / detectors;
+            unsigned j = r % detectors;
+            double sx = center + _distance * _cos_source[k];
+            double sy = center + _distance * _sin_source[k];
+            // Direccion hacia el centro, girada en el angulo del detector
+            double ux = -_cos_source[k], uy = -_sin_source[k];
+            double dx = ux * _cos_fan[j] - uy * _sin_fan[j];
+            double dy = ux * _sin_fan[j] + uy * _cos_fan[j];
+            batch.push_back(Line(sx, sy, sx + 2.0 * _distance * dx, sy + 2.0 * _distance * dy));
+        }
+    }
+    
+private:
+
+    unsigned _n;
+    double _distance;
+    vector<double> _cos_source;
+    vector<double> _sin_source;
+    vector<double> _cos_fan;
+    vector<double> _sin_fan;
+
+};
+
+void complete_geometry(GeometryParams& params, unsigned image_size, unsigned discr_size)
+{
+    if (params.type != PARALLEL_BEAM and params.type != FAN_BEAM) {
+        return;
+    }
+    if (params.detectors == 0) {
+        params.detectors = (unsigned)ceil(sqrt(2.0) * discr_size);
+    }
+    if (params.angles == 0) {
+        // El abanico da la vuelta completa, asi que cada recta se mide
+        // dos veces: hacen falta el doble de posiciones
+        double turns = params.type == FAN_BEAM ? 2.0 : 1.0;
+        params.angles = (unsigned)ceil(turns * M_PI / 2.0 * params.detectors);
+    }
+    if (params.type == FAN_BEAM and params.source_distance == 0.0) {
+        params.source_distance = 2.0 * image_size;
+    }
+}
+
+unique_ptr<Geometry> make_geometry(const GeometryParams& params, unsigned image_size, uint64_t seed)
+{
+    switch (params.type) {
+    case FULL_GEOMETRY:
+        return unique_ptr<Geometry>(new FullGeometry(image_size));
+    case AXIS_GEOMETRY:
+        return unique_ptr<Geometry>(new AxisGeometry(image_size));
+    case CORNER_GEOMETRY:
+        return unique_ptr<Geometry>(new CornerGeometry(image_size));
+    case RANDOM_GEOMETRY:
+        return unique_ptr<Geometry>(new RandomGeometry(image_size, params.num_rays, seed));
+    case PARALLEL_BEAM:
+        return unique_ptr<Geometry>(new ParallelBeamGeometry(image_size, params.angles, params.detectors));
+    default:
+        return unique_ptr<Geometry>(new FanBeamGeometry(image_size, params.angles, params.detectors, params.source_distance));
+    }
+}
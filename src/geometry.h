@@ -0,0 +1,124 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+/** Recta que pasa por los puntos (x0,y0) y (x1,y1), en coordenadas de
+ *  la imagen (el pixel (i,j) ocupa [j,j+1]x[i,i+1], con el eje y hacia
+ *  abajo). Un rayo es la recta entera, recortada a la imagen. */
+struct Line
+{
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+    
+    Line(double x0, double y0, double x1, double y1)
+    : x0(x0), y0(y0), x1(x1), y1(y1) {}
+};
+
+/** Rayo que pasa por los centros de los pixeles (x0,y0) y (x1,y1). */
+struct Ray
+{
+    unsigned x0;
+    unsigned y0;
+    unsigned x1;
+    unsigned y1;
+    
+    Ray(unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+    : x0(x0), y0(y0), x1(x1), y1(y1) {}
+};
+
+enum GeometryType {
+    FULL_GEOMETRY,      // metodo 0: todos los rayos entre lados opuestos
+    AXIS_GEOMETRY,      // metodo 1: verticales, horizontales y diagonales
+    CORNER_GEOMETRY,    // metodo 2: barridos desde las cuatro esquinas
+    RANDOM_GEOMETRY,    // rayos aleatorios entre dos lados
+    PARALLEL_BEAM,      // tomografo de haces paralelos
+    FAN_BEAM            // tomografo de haz en abanico
+};
+
+/** Parametros de la geometria de los rayos. */
+struct GeometryParams
+{
+    GeometryType type;
+    
+    /** Cantidad de rayos de RANDOM_GEOMETRY. */
+    unsigned num_rays;
+    
+    /** Cantidad de angulos (posiciones de la fuente) y de detectores
+     *  por angulo de PARALLEL_BEAM y FAN_BEAM. */
+    unsigned angles;
+    unsigned detectors;
+    
+    /** Distancia, en pixeles, entre la fuente de FAN_BEAM y el centro
+     *  de la imagen. */
+    double source_distance;
+    
+    GeometryParams()
+    : type(FULL_GEOMETRY), num_rays(0), angles(0), detectors(0), source_distance(0.0) {}
+};
+
+class PixelGeometry;
+
+/** Generador de los rayos de una geometria. Los rayos se numeran de 0
+ *  a num_rays() - 1 y cada uno se calcula a partir de su indice, asi
+ *  que se pueden pedir de a tandas, en cualquier orden y desde varios
+ *  hilos, sin guardarlos todos. */
+class Geometry
+{
+
+public:
+
+    virtual ~Geometry() {}
+    
+    virtual unsigned num_rays() const = 0;
+    
+    /** Deja en batch las rectas de los rayos [begin, end). */
+    virtual void lines(unsigned begin, unsigned end, std::vector<Line>& batch) const = 0;
+    
+    /** Si los rayos pasan por centros de pixeles (los metodos 0, 1, 2 y
+     *  los aleatorios), la misma geometria vista como PixelGeometry,
+     *  para el trazado por pixeles exacto; si no, nulo. */
+    virtual const PixelGeometry* pixel_geometry() const {
+        return 0;
+    }
+
+};
+
+/** Geometria cuyos rayos van entre centros de pixeles. */
+class PixelGeometry : public Geometry
+{
+
+public:
+
+    /** Rayo de indice r. */
+    virtual Ray ray(unsigned r) const = 0;
+    
+    /** Deja en batch los rayos [begin, end). */
+    void rays(unsigned begin, unsigned end, std::vector<Ray>& batch) const;
+    
+    void lines(unsigned begin, unsigned end, std::vector<Line>& batch) const;
+    
+    const PixelGeometry* pixel_geometry() const {
+        return this;
+    }
+
+};
+
+/** Completa los parametros de PARALLEL_BEAM y FAN_BEAM que valen 0
+ *  con valores por defecto para una discretizacion de discr_size x
+ *  discr_size celdas: un detector por celda a lo largo de la diagonal,
+ *  pi/2 angulos por detector (asi, en las esquinas de la imagen, los
+ *  rayos de dos angulos vecinos quedan tan separados como los de dos
+ *  detectores vecinos; el doble en el abanico, que da la vuelta
+ *  completa) y la fuente a dos lados de imagen del centro. */
+void complete_geometry(GeometryParams& params, unsigned image_size, unsigned discr_size);
+
+/** Geometria de los parametros dados para una imagen de image_size x
+ *  image_size pixeles. Los rayos aleatorios salen de la semilla seed. */
+std::unique_ptr<Geometry> make_geometry(const GeometryParams& params, unsigned image_size, uint64_t seed);
+
+#endif
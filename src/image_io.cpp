@@ -0,0 +1,252 @@
+#include "image_io.h"
+#include "cache.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+using namespace std;
+
+static bool has_extension(const string& filename, const char* extension)
+{
+    size_t length = strlen(extension);
+    if (filename.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (tolower(filename[filename.size() - length + i]) != extension[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ImageFormat image_format(const string& filename)
+{
+    if (has_extension(filename, ".pgm")) {
+        return PGM_IMAGE;
+    }
+    else if (has_extension(filename, ".raw")) {
+        return RAW_IMAGE;
+    }
+    return CSV_IMAGE;
+}
+
+static bool is_digit(char c)
+{
+    return c >= '0' and c <= '9';
+}
+
+static bool is_blank(char c)
+{
+    return c == ' ' or c == '\t' or c == '\r';
+}
+
+/* CSV con un numero por pixel, separados por comas, y una fila por
+ * linea. Se recorre directamente el archivo mapeado, sin armar strings
+ * intermedios, y los pixeles se van agregando a un unico arreglo. Las
+ * lineas vacias se ignoran. */
+static bool parse_csv(const char* p, const char* end, ImageBuffer& image)
+{
+    vector<unsigned char> pixels;
+    unsigned width = 0, height = 0;
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (eol == 0) {
+            eol = end;
+        }
+        
+        size_t row_start = pixels.size();
+        while (p < eol) {
+            while (p < eol and is_blank(*p)) {
+                p++;
+            }
+            if (p == eol) {
+                break;
+            }
+            if (!is_digit(*p)) {
+                return false;
+            }
+            unsigned value = 0;
+            while (p < eol and is_digit(*p)) {
+                value = value * 10 + (*p - '0');
+                p++;
+            }
+            pixels.push_back((unsigned char)value);
+            while (p < eol and is_blank(*p)) {
+                p++;
+            }
+            if (p < eol and *p++ != ',') {
+                return false;
+            }
+        }
+        
+        size_t row_size = pixels.size() - row_start;
+        if (row_size != 0) {
+            if (height == 0) {
+                width = row_size;
+                // Suponemos que la imagen es cuadrada para reservar
+                pixels.reserve((size_t)width * width);
+            }
+            else if (row_size != width) {
+                return false;
+            }
+            height++;
+        }
+        p = eol + 1;
+    }
+    
+    image = ImageBuffer(width, height, move(pixels));
+    return height != 0;
+}
+
+/* Numero del encabezado de un PGM, salteando espacios y comentarios. */
+static bool pgm_number(const char*& p, const char* end, unsigned& value)
+{
+    while (p < end and (isspace((unsigned char)*p) or *p == '#')) {
+        if (*p == '#') {
+            while (p < end and *p != '\n') {
+                p++;
+            }
+        }
+        else {
+            p++;
+        }
+    }
+    if (p == end or !is_digit(*p)) {
+        return false;
+    }
+    value = 0;
+    while (p < end and is_digit(*p)) {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    return true;
+}
+
+/* PGM binario: "P5", ancho, alto y valor maximo, un espacio, y los
+ * pixeles por filas, de un byte si el maximo es menor a 256 y de dos
+ * (el mas significativo primero) si no. */
+static bool parse_pgm(const char* p, const char* end, ImageBuffer& image)
+{
+    unsigned width, height, maxval;
+    p += 2;
+    if (!pgm_number(p, end, width) or !pgm_number(p, end, height) or !pgm_number(p, end, maxval)) {
+        return false;
+    }
+    if (width == 0 or height == 0 or maxval == 0 or maxval > 65535 or p == end or !isspace((unsigned char)*p)) {
+        return false;
+    }
+    p++;
+    
+    size_t bytes = maxval < 256 ? 1 : 2;
+    if ((size_t)(end - p) < (size_t)width * height * bytes) {
+        return false;
+    }
+    
+    image = ImageBuffer(width, height);
+    const unsigned char* data = (const unsigned char*)p;
+    size_t count = (size_t)width * height;
+    if (bytes == 1) {
+        memcpy(image.data(), data, count);
+    }
+    else {
+        unsigned char* pixels = image.data();
+        for (size_t k = 0; k < count; k++) {
+            unsigned value = min((unsigned)((data[2*k] << 8) | data[2*k + 1]), maxval);
+            pixels[k] = (unsigned char)((value * 255 + maxval / 2) / maxval);
+        }
+    }
+    return true;
+}
+
+/* Bytes sin encabezado; la imagen tiene que ser cuadrada. */
+static bool parse_raw(const char* p, size_t size, ImageBuffer& image)
+{
+    size_t n = (size_t)sqrt((double)size);
+    while (n * n > size) {
+        n--;
+    }
+    while ((n + 1) * (n + 1) <= size) {
+        n++;
+    }
+    if (n == 0 or n * n != size) {
+        return false;
+    }
+    
+    image = ImageBuffer(n, n);
+    memcpy(image.data(), p, size);
+    return true;
+}
+
+bool load_image(const string& filename, ImageBuffer& image)
+{
+    size_t size;
+    shared_ptr<const void> mapping = map_file(filename, 1, size);
+    if (!mapping) {
+        return false;
+    }
+    
+    const char* data = (const char*)mapping.get();
+    if (size >= 2 and data[0] == 'P' and data[1] == '5') {
+        return parse_pgm(data, data + size, image);
+    }
+    
+    switch (image_format(filename)) {
+    case RAW_IMAGE:
+        return parse_raw(data, size, image);
+    case PGM_IMAGE:
+        return false;
+    default:
+        return parse_csv(data, data + size, image);
+    }
+}
+
+static void append_number(string& buffer, unsigned value)
+{
+    char digits[10];
+    unsigned length = 0;
+    do {
+        digits[length++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (length > 0) {
+        buffer.push_back(digits[--length]);
+    }
+}
+
+/* La imagen se arma entera en memoria y se escribe de una vez. */
+bool save_image(const string& filename, const ImageBuffer& image)
+{
+    string buffer;
+    ImageFormat format = image_format(filename);
+    
+    if (format == CSV_IMAGE) {
+        buffer.reserve((size_t)image.width() * image.height() * 5);
+        for (unsigned i = 0; i < image.height(); i++) {
+            for (unsigned j = 0; j < image.width(); j++) {
+                if (j != 0) {
+                    buffer.append(", ");
+                }
+                append_number(buffer, image(i,j));
+            }
+            buffer.push_back('\n');
+        }
+    }
+    else {
+        if (format == PGM_IMAGE) {
+            buffer.append("P5\n");
+            append_number(buffer, image.width());
+            buffer.push_back(' ');
+            append_number(buffer, image.height());
+            buffer.append("\n255\n");
+        }
+        buffer.append((const char*)image.data(), (size_t)image.width() * image.height());
+    }
+    
+    ofstream ofile(filename, ios::binary);
+    ofile.write(buffer.data(), buffer.size());
+    return !ofile.fail();
+}
@@ -0,0 +1,87 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Imagen en escala de grises de width x height pixeles, guardada por 
+ *  filas en un unico arreglo contiguo. */
+class ImageBuffer
+{
+
+public:
+
+    ImageBuffer() : _width(0), _height(0) {}
+    
+    ImageBuffer(unsigned width, unsigned height)
+    : _pixels((size_t)width * height), _width(width), _height(height) {}
+    
+    /** Imagen sobre los pixeles dados, por filas (se mueven, no se 
+     *  copian). */
+    ImageBuffer(unsigned width, unsigned height, std::vector<unsigned char>&& pixels)
+    : _pixels(std::move(pixels)), _width(width), _height(height) {}
+    
+    unsigned width() const {
+        return _width;
+    }
+    
+    unsigned height() const {
+        return _height;
+    }
+    
+    /** Lado de la imagen (cantidad de filas), para las imagenes 
+     *  cuadradas con las que trabaja el programa. */
+    unsigned size() const {
+        return _height;
+    }
+    
+    unsigned char& operator()(unsigned i, unsigned j) {
+        return _pixels[(size_t)i * _width + j];
+    }
+    
+    unsigned char operator()(unsigned i, unsigned j) const {
+        return _pixels[(size_t)i * _width + j];
+    }
+    
+    unsigned char* data() {
+        return _pixels.data();
+    }
+    
+    const unsigned char* data() const {
+        return _pixels.data();
+    }
+    
+private:
+
+    std::vector<unsigned char> _pixels;
+    unsigned _width;
+    unsigned _height;
+
+};
+
+enum ImageFormat {
+    CSV_IMAGE,
+    PGM_IMAGE,
+    RAW_IMAGE
+};
+
+/** Formato que corresponde a la extension del archivo: .pgm es PGM
+ *  binario, .raw es una imagen cuadrada de bytes sin encabezado, y
+ *  cualquier otra cosa es CSV. */
+ImageFormat image_format(const std::string& filename);
+
+/** Lee una imagen mapeando el archivo en memoria. Si empieza con el
+ *  numero magico P5 se lee como PGM binario (de 8 o 16 bits; las de 16
+ *  se llevan a [0,255]), sin importar la extension; si no, el formato
+ *  sale de la extension. Devuelve falso si el archivo no existe o no
+ *  se pudo interpretar (en un CSV, tambien si las filas no tienen todas 
+ *  la misma cantidad de pixeles). */
+bool load_image(const std::string& filename, ImageBuffer& image);
+
+/** Guarda la imagen en el formato que corresponde a la extension.
+ *  Devuelve falso si no se pudo escribir. */
+bool save_image(const std::string& filename, const ImageBuffer& image);
+
+#endif
@@ -0,0 +1,690 @@
+#include "iterative.h"
+#include "sparse_matrix.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "row_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+using namespace std;
+
+// Cada cuantas iteraciones CGLS recalcula el residuo con la D en double, 
+// en precision mixta
+#define MIXED_REFRESH_INTERVAL 10
+
+// Cantidad minima de elementos de cada bloque de SART por hilo
+#define SART_PARALLEL_ELEMENTS 4096
+
+/* x inicial para el k-esimo b: el dado, o cero si no se dio ninguno. */
+template <class M>
+static Vector initial_guess(const M& A, const vector<Vector>& x0s, unsigned k)
+{
+    return x0s.empty() ? Vector(A.num_columns(), 0.0) : x0s[k];
+}
+
+template <class U, class V>
+static vector<U> convert(const vector<V>& v)
+{
+    return vector<U>(v.begin(), v.end());
+}
+
+/* Las normas se acumulan siempre en double, sea cual sea el tipo de 
+ * los vectores. */
+template <class U>
+static double squared_norm(const vector<U>& x)
+{
+    double res = 0.0;
+    for (unsigned i = 0; i < x.size(); i++) {
+        res += (double)x[i] * x[i];
+    }
+    return res;
+}
+
+/* Tipo de la A exacta de la precision mixta para vectores en U. Solo 
+ * se da con vectores en double (y es la A original); con vectores en 
+ * float es siempre nula, y asi no hace falta el producto de una matriz 
+ * en double por un vector en float. Ademas deja a U fuera de la 
+ * deduccion, para que se pueda pasar 0. */
+template <class U>
+struct ExactMatrix
+{
+    typedef BasicSparseMatrix<U> type;
+};
+
+/* ||b - A*x||, con la A exacta si se dio (precision mixta) o con la 
+ * que usa el metodo si no. */
+template <class M, class U>
+static double residual_norm(const M& A, const typename ExactMatrix<U>::type* exact, const vector<U>& b, const vector<U>& x)
+{
+    vector<U> r = exact != 0 ? (*exact) * x : A * x;
+    double res = 0.0;
+    for (unsigned i = 0; i < r.size(); i++) {
+        res += ((double)b[i] - r[i]) * ((double)b[i] - r[i]);
+    }
+    return sqrt(res);
+}
+
+/* Copia en precision simple de A para los modos single y mixed (vacia 
+ * en double). */
+static SparseMatrixF single_precision_copy(const SparseMatrix& A, const IterativeParams& params)
+{
+    return params.precision == DOUBLE_PRECISION ? SparseMatrixF() : SparseMatrixF(A, A.has_rows());
+}
+
+/* CGLS clasico: es equivalente a aplicar gradientes conjugados a 
+ * A^t A x = A^t b pero sin formar A^t A, y trabajando con el residuo 
+ * r = b - Ax en vez de con el de las ecuaciones normales, lo cual es 
+ * numericamente mas estable. Se parte del x dado. Con lambda > 0 el 
+ * sistema es (A^t A + lambda^2 I) x = A^t b: el gradiente pasa a ser 
+ * s = A^t r - lambda^2 x y la curvatura de cada direccion p suma 
+ * lambda^2 ||p||^2, sin ningun producto extra por A. El criterio de 
+ * corte es siempre relativo a ||A^t b||, asi que un buen x inicial 
+ * ahorra iteraciones.
+ *
+ * A es una BasicSparseMatrix con los valores en float o double, o un 
+ * RowFile, y las cuentas se hacen en U. Si se da exact (la A en 
+ * double, en precision mixta), cada MIXED_REFRESH_INTERVAL iteraciones 
+ * el residuo se recalcula como b - exact*x, con lo que el error de 
+ * redondeo de la recurrencia de r no se acumula y r vuelve a ser el 
+ * de la A exacta. El gradiente s = A^t r se sigue calculando con la A 
+ * en float (usar la exacta solo en algunas iteraciones rompe la 
+ * conjugacion de las direcciones), asi que el x al que se converge 
+ * resuelve A^t (b - exact*x) = 0 con la A en float: difiere del de 
+ * double en el orden del error relativo de float por el numero de 
+ * condicion de A, y el criterio de corte mide ese gradiente. Con el 
+ * trazado por pixeles los valores de A son enteros y float los 
+ * representa sin error, asi que el resultado es el de double. */
+template <class M, class U>
+static vector<U> cgls(const M& A, const vector<U>& b, vector<U> x, const IterativeParams& params, const typename ExactMatrix<U>::type* exact, unsigned& iterations)
+{
+    unsigned n = A.num_columns();
+    
+    U damping = params.lambda * params.lambda;
+    bool cold = squared_norm(x) == 0.0;
+    vector<U> r = b;
+    if (!cold) {
+        vector<U> ax = exact != 0 ? (*exact) * x : A * x;
+        for (unsigned i = 0; i < r.size(); i++) {
+            r[i] -= ax[i];
+        }
+    }
+    vector<U> s = transposed_product(A, r);
+    for (unsigned i = 0; i < n and !cold and damping != 0.0; i++) {
+        s[i] -= damping * x[i];
+    }
+    vector<U> p = s;
+    vector<U> q;
+    
+    double gamma = squared_norm(s);
+    double reference = cold ? gamma : squared_norm(transposed_product(A, b));
+    double stop = params.tolerance * params.tolerance * reference;
+    
+    iterations = 0;
+    while (iterations < params.max_iterations and gamma > stop) {
+        q = A*p;
+        double q_norm = squared_norm(q) + damping * squared_norm(p);
+        if (q_norm == 0.0) {
+            break;
+        }
+        U alpha = gamma / q_norm;
+        
+        for (unsigned i = 0; i < n; i++) {
+            x[i] += alpha * p[i];
+        }
+        if (exact != 0 and (iterations + 1) % MIXED_REFRESH_INTERVAL == 0) {
+            vector<U> ax = (*exact) * x;
+            for (unsigned i = 0; i < r.size(); i++) {
+                r[i] = b[i] - ax[i];
+            }
+        }
+        else {
+            for (unsigned i = 0; i < r.size(); i++) {
+                r[i] -= alpha * q[i];
+            }
+        }
+        
+        s = transposed_product(A, r);
+        if (damping != 0.0) {
+            for (unsigned i = 0; i < n; i++) {
+                s[i] -= damping * x[i];
+            }
+        }
+        double new_gamma = squared_norm(s);
+        U beta = new_gamma / gamma;
+        gamma = new_gamma;
+        
+        for (unsigned i = 0; i < n; i++) {
+            p[i] = s[i] + beta * p[i];
+        }
+        
+        iterations++;
+    }
+    
+    return x;
+}
+
+vector<Vector> cgls(const SparseMatrix& A, const vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const vector<Vector>& x0s)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    SparseMatrixF single = single_precision_copy(A, params);
+    vector<Vector> results(bs.size());
+    metrics.num_iterations = 0;
+    
+    for (unsigned k = 0; k < bs.size(); k++) {
+        unsigned iterations;
+        Vector x0 = initial_guess(A, x0s, k);
+        if (params.precision == DOUBLE_PRECISION) {
+            results[k] = cgls(A, bs[k], x0, params, 0, iterations);
+        }
+        else if (params.precision == SINGLE_PRECISION) {
+            results[k] = convert<double>(cgls(single, convert<float>(bs[k]), convert<float>(x0), params, 0, iterations));
+        }
+        else {
+            results[k] = cgls(single, bs[k], x0, params, &A, iterations);
+        }
+        if (iterations > metrics.num_iterations) {
+            metrics.num_iterations = iterations;
+        }
+    }
+    
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    metrics.cond_number = 0.0;
+    metrics.num_eigen_found = 0;
+    
+    return results;
+}
+
+/* Criterio de corte de ART y SART, evaluado al final de cada pasada. 
+ * Con datos ruidosos el sistema es inconsistente y ||r|| no llega a 
+ * cero, asi que tambien se corta cuando deja de bajar. */
+static bool converged(double residual, double previous, double b_norm, const IterativeParams& params)
+{
+    return residual <= params.tolerance * b_norm or previous - residual <= params.tolerance * previous;
+}
+
+/* Orden inicial de las filas (o bloques) de cada pasada. */
+static vector<unsigned> identity_order(unsigned n)
+{
+    vector<unsigned> order(n);
+    for (unsigned i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    return order;
+}
+
+/* Cada paso proyecta x sobre el hiperplano a_i^t x = b_i, relajado: 
+ * x += relaxation * (b_i - a_i^t x) / ||a_i||^2 * a_i. Las filas nulas 
+ * (rayos que no tocan ninguna celda) se saltean. El orden al azar sale 
+ * de un generador propio con semilla fija, para que el resultado no 
+ * dependa de en que hilo se resuelva cada b. Los tipos son como en 
+ * CGLS; en precision mixta el residuo de cada pasada se mide con la A 
+ * exacta. */
+template <class T, class U>
+static vector<U> art(const BasicSparseMatrix<T>& A, const vector<U>& b, vector<U> x, const vector<U>& row_norms, const IterativeParams& params, const typename ExactMatrix<U>::type* exact, unsigned seed, unsigned& iterations)
+{
+    unsigned m = A.num_rows();
+    
+    vector<unsigned> order = identity_order(m);
+    minstd_rand generator(seed);
+    
+    double b_norm = sqrt(squared_norm(b));
+    double previous = squared_norm(x) == 0.0 ? b_norm : residual_norm(A, exact, b, x);
+    
+    iterations = 0;
+    while (iterations < params.max_iterations) {
+        if (params.random_order) {
+            shuffle(order.begin(), order.end(), generator);
+        }
+        for (unsigned k = 0; k < m; k++) {
+            unsigned i = order[k];
+            if (row_norms[i] == 0.0) {
+                continue;
+            }
+            BasicSparseVectorView<T> row = A.get_row(i);
+            U ax = 0.0;
+            for (size_t p = 0; p < row.size(); p++) {
+                ax += row.value(p) * x[row.index(p)];
+            }
+            U c = params.relaxation * (b[i] - ax) / row_norms[i];
+            for (size_t p = 0; p < row.size(); p++) {
+                x[row.index(p)] += c * row.value(p);
+            }
+        }
+        iterations++;
+        
+        double residual = residual_norm(A, exact, b, x);
+        if (converged(residual, previous, b_norm, params)) {
+            break;
+        }
+        previous = residual;
+    }
+    
+    return x;
+}
+
+/* Norma al cuadrado de cada fila de A. */
+template <class T, class U>
+static vector<U> row_norms(const BasicSparseMatrix<T>& A)
+{
+    vector<U> res(A.num_rows());
+    for (unsigned i = 0; i < A.num_rows(); i++) {
+        BasicSparseVectorView<T> row = A.get_row(i);
+        U temp = 0.0;
+        for (size_t p = 0; p < row.size(); p++) {
+            temp += row.value(p) * row.value(p);
+        }
+        res[i] = temp;
+    }
+    return res;
+}
+
+/* Las semillas de cada b se sacan de rand() antes de repartir el 
+ * trabajo, asi el resultado depende solo de la semilla global. */
+vector<Vector> art(const SparseMatrix& A, const vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const vector<Vector>& x0s)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    SparseMatrixF single = single_precision_copy(A, params);
+    Vector norms = params.precision == SINGLE_PRECISION ? Vector() : 
+                   params.precision == DOUBLE_PRECISION ? row_norms<double,double>(A) : row_norms<float,double>(single);
+    vector<float> single_norms = params.precision == SINGLE_PRECISION ? row_norms<float,float>(single) : vector<float>();
+    
+    vector<unsigned> seeds(bs.size());
+    for (unsigned k = 0; k < bs.size(); k++) {
+        seeds[k] = rand();
+    }
+    
+    vector<Vector> results(bs.size());
+    vector<unsigned> iterations(bs.size());
+    parallel_for(bs.size(), [&](unsigned, unsigned begin, unsigned end) {
+        for (unsigned k = begin; k < end; k++) {
+            Vector x0 = initial_guess(A, x0s, k);
+            if (params.precision == DOUBLE_PRECISION) {
+                results[k] = art(A, bs[k], x0, norms, params, 0, seeds[k], iterations[k]);
+            }
+            else if (params.precision == SINGLE_PRECISION) {
+                results[k] = convert<double>(art(single, convert<float>(bs[k]), convert<float>(x0), single_norms, params, 0, seeds[k], iterations[k]));
+            }
+            else {
+                results[k] = art(single, bs[k], x0, norms, params, &A, seeds[k], iterations[k]);
+            }
+        }
+    });
+    
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    metrics.num_iterations = bs.empty() ? 0 : *max_element(iterations.begin(), iterations.end());
+    metrics.cond_number = 0.0;
+    metrics.num_eigen_found = 0;
+    
+    return results;
+}
+
+/* Tramo de la columna column de la CSC con las filas de un bloque de 
+ * SART: las posiciones [first, first + count). */
+struct ColumnSegment
+{
+    size_t first;
+    unsigned column;
+    unsigned count;
+};
+
+/* Primera fila de cada bloque de SART (y m al final). */
+static vector<unsigned> block_starts(unsigned m, unsigned blocks)
+{
+    vector<unsigned> starts(blocks + 1);
+    for (unsigned s = 0; s <= blocks; s++) {
+        starts[s] = (unsigned)((unsigned long long)m * s / blocks);
+    }
+    return starts;
+}
+
+/* Para cada bloque, los tramos de las columnas que lo tocan. Como las 
+ * filas de cada columna de la CSC estan ordenadas, las de un bloque 
+ * quedan contiguas; entre todos los bloques hay a lo sumo un tramo por 
+ * elemento de A, y se arman una sola vez recorriendo la CSC. */
+template <class T>
+static vector<vector<ColumnSegment> > column_segments(const BasicSparseMatrix<T>& A, const vector<unsigned>& starts)
+{
+    unsigned blocks = starts.size() - 1;
+    vector<unsigned> block_of(A.num_rows());
+    for (unsigned s = 0; s < blocks; s++) {
+        fill(block_of.begin() + starts[s], block_of.begin() + starts[s+1], s);
+    }
+    
+    vector<vector<ColumnSegment> > segments(blocks);
+    const size_t* col_ptr = A.col_ptr();
+    const unsigned* row_idx = A.row_indices();
+    for (unsigned j = 0; j < A.num_columns(); j++) {
+        for (size_t k = col_ptr[j]; k < col_ptr[j+1]; ) {
+            unsigned s = block_of[row_idx[k]];
+            ColumnSegment segment;
+            segment.first = k;
+            segment.column = j;
+            for (; k < col_ptr[j+1] and row_idx[k] < starts[s+1]; k++);
+            segment.count = k - segment.first;
+            segments[s].push_back(segment);
+        }
+    }
+    return segments;
+}
+
+/* Una pasada de SART. Para cada bloque de filas [r0, r1) se calcula 
+ * primero el residuo normalizado w_i = (b_i - a_i^t x) / sum_j a_ij de 
+ * cada fila (repartiendo las filas entre los hilos), y despues cada x_j 
+ * se actualiza con relaxation * sum_i a_ij w_i / sum_i a_ij, sumando 
+ * solo sobre las filas del bloque (repartiendo los tramos de columna 
+ * del bloque). Asi cada bloque cuesta lo que sus elementos, y no 
+ * depende de la cantidad de columnas. Los hilos se lanzan una vez por 
+ * pasada y se esperan con una barrera entre una fase y la otra. Cada 
+ * x_j lo acumula un solo hilo y siempre en el orden de las filas, asi 
+ * que el resultado es el mismo para cualquier cantidad de hilos. */
+template <class T, class U>
+static void sart_pass(const BasicSparseMatrix<T>& A, const vector<U>& b, const vector<U>& row_sums, const vector<unsigned>& starts, const vector<vector<ColumnSegment> >& segments, const vector<unsigned>& order, U relaxation, unsigned threads, vector<U>& w, vector<U>& x)
+{
+    const unsigned* row_idx = A.row_indices();
+    const T* values = A.values();
+    Barrier barrier(threads);
+    parallel_for(threads, [&](unsigned t, unsigned, unsigned) {
+        for (unsigned k = 0; k < order.size(); k++) {
+            unsigned s = order[k];
+            unsigned r0 = starts[s];
+            unsigned rows = starts[s+1] - r0;
+            unsigned first = r0 + (unsigned)((unsigned long long)rows * t / threads);
+            unsigned last = r0 + (unsigned)((unsigned long long)rows * (t + 1) / threads);
+            for (unsigned i = first; i < last; i++) {
+                if (row_sums[i] == 0.0) {
+                    w[i] = 0.0;
+                    continue;
+                }
+                BasicSparseVectorView<T> row = A.get_row(i);
+                U ax = 0.0;
+                for (size_t p = 0; p < row.size(); p++) {
+                    ax += row.value(p) * x[row.index(p)];
+                }
+                w[i] = (b[i] - ax) / row_sums[i];
+            }
+            barrier.wait();
+            
+            const vector<ColumnSegment>& block = segments[s];
+            size_t begin = block.size() * t / threads;
+            size_t end = block.size() * (t + 1) / threads;
+            for (size_t q = begin; q < end; q++) {
+                const ColumnSegment& segment = block[q];
+                U num = 0.0, den = 0.0;
+                for (size_t p = segment.first; p < segment.first + segment.count; p++) {
+                    num += values[p] * w[row_idx[p]];
+                    den += values[p];
+                }
+                if (den != 0.0) {
+                    x[segment.column] += relaxation * num / den;
+                }
+            }
+            barrier.wait();
+        }
+    }, threads);
+}
+
+template <class T, class U>
+static vector<U> sart(const BasicSparseMatrix<T>& A, const vector<U>& b, vector<U> x, const vector<U>& row_sums, const IterativeParams& params, const typename ExactMatrix<U>::type* exact, unsigned seed, unsigned& iterations)
+{
+    unsigned m = A.num_rows();
+    unsigned blocks = max(1u, min(params.blocks, m));
+    vector<unsigned> starts = block_starts(m, blocks);
+    vector<vector<ColumnSegment> > segments = column_segments(A, starts);
+    
+    // Con bloques chicos no vale la pena repartir el trabajo
+    size_t per_block = A.num_nonzeros() / blocks;
+    unsigned threads = max((size_t)1, min((size_t)num_threads(), per_block / SART_PARALLEL_ELEMENTS));
+    
+    vector<U> w(m, 0.0);
+    vector<unsigned> order = identity_order(blocks);
+    minstd_rand generator(seed);
+    
+    double b_norm = sqrt(squared_norm(b));
+    double previous = squared_norm(x) == 0.0 ? b_norm : residual_norm(A, exact, b, x);
+    
+    iterations = 0;
+    while (iterations < params.max_iterations) {
+        if (params.random_order) {
+            shuffle(order.begin(), order.end(), generator);
+        }
+        sart_pass(A, b, row_sums, starts, segments, order, (U)params.relaxation, threads, w, x);
+        iterations++;
+        
+        double residual = residual_norm(A, exact, b, x);
+        if (converged(residual, previous, b_norm, params)) {
+            break;
+        }
+        previous = residual;
+    }
+    
+    return x;
+}
+
+/* Suma de cada fila de A. */
+template <class T, class U>
+static vector<U> row_sums(const BasicSparseMatrix<T>& A)
+{
+    vector<U> res(A.num_rows());
+    for (unsigned i = 0; i < A.num_rows(); i++) {
+        BasicSparseVectorView<T> row = A.get_row(i);
+        U temp = 0.0;
+        for (size_t p = 0; p < row.size(); p++) {
+            temp += row.value(p);
+        }
+        res[i] = temp;
+    }
+    return res;
+}
+
+vector<Vector> sart(const SparseMatrix& A, const vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const vector<Vector>& x0s)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    SparseMatrixF single = single_precision_copy(A, params);
+    Vector sums = params.precision == SINGLE_PRECISION ? Vector() : 
+                  params.precision == DOUBLE_PRECISION ? row_sums<double,double>(A) : row_sums<float,double>(single);
+    vector<float> single_sums = params.precision == SINGLE_PRECISION ? row_sums<float,float>(single) : vector<float>();
+    
+    vector<Vector> results(bs.size());
+    metrics.num_iterations = 0;
+    
+    for (unsigned k = 0; k < bs.size(); k++) {
+        unsigned iterations;
+        Vector x0 = initial_guess(A, x0s, k);
+        if (params.precision == DOUBLE_PRECISION) {
+            results[k] = sart(A, bs[k], x0, sums, params, 0, rand(), iterations);
+        }
+        else if (params.precision == SINGLE_PRECISION) {
+            results[k] = convert<double>(sart(single, convert<float>(bs[k]), convert<float>(x0), single_sums, params, 0, rand(), iterations));
+        }
+        else {
+            results[k] = sart(single, bs[k], x0, sums, params, &A, rand(), iterations);
+        }
+        if (iterations > metrics.num_iterations) {
+            metrics.num_iterations = iterations;
+        }
+    }
+    
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    metrics.cond_number = 0.0;
+    metrics.num_eigen_found = 0;
+    
+    return results;
+}
+
+/* Los productos por A recorren el archivo, asi que cada iteracion lo 
+ * lee dos veces. Como RowFile suma en el mismo orden que SparseMatrix, 
+ * el resultado es el mismo que con D en memoria. */
+vector<Vector> cgls(const RowFile& A, const vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const vector<Vector>& x0s)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    vector<Vector> results(bs.size());
+    metrics.num_iterations = 0;
+    
+    for (unsigned k = 0; k < bs.size(); k++) {
+        unsigned iterations;
+        results[k] = cgls(A, bs[k], initial_guess(A, x0s, k), params, 0, iterations);
+        if (iterations > metrics.num_iterations) {
+            metrics.num_iterations = iterations;
+        }
+    }
+    
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    metrics.cond_number = 0.0;
+    metrics.num_eigen_found = 0;
+    
+    return results;
+}
+
+/* SART sobre las filas del archivo. Cada bloque de SART es un tramo de 
+ * filas consecutivas, asi que en cada pasada se leen, para cada bloque 
+ * en el orden de la pasada, los bloques del archivo que lo cortan (el 
+ * que comparte con el bloque anterior se lee una sola vez y sirve para 
+ * los dos). Las filas de cada bloque se recorren en orden calculando 
+ * su w_i y acumulando sum_i a_ij w_i y sum_i a_ij en cada columna, y 
+ * al terminar el bloque se actualizan las x_j de las columnas que toco. 
+ * Las sumas de cada columna quedan en el mismo orden que en sart_pass, 
+ * y el resultado es el mismo que con D en memoria. */
+static Vector sart(const RowFile& A, const Vector& b, Vector x, const Vector& row_sums, const IterativeParams& params, unsigned seed, unsigned& iterations)
+{
+    unsigned m = A.num_rows();
+    unsigned n = A.num_columns();
+    unsigned blocks = max(1u, min(params.blocks, m));
+    
+    vector<unsigned> chunk_ends(A.num_chunks());
+    for (unsigned c = 0; c < A.num_chunks(); c++) {
+        chunk_ends[c] = A.chunk_end(c);
+    }
+    
+    Vector num(n, 0.0), den(n, 0.0);
+    vector<bool> touched(n, false);
+    vector<unsigned> columns;
+    vector<unsigned> order = identity_order(blocks);
+    minstd_rand generator(seed);
+    
+    double b_norm = sqrt(squared_norm(b));
+    double previous = squared_norm(x) == 0.0 ? b_norm : residual_norm(A, 0, b, x);
+    
+    iterations = 0;
+    while (iterations < params.max_iterations) {
+        if (params.random_order) {
+            shuffle(order.begin(), order.end(), generator);
+        }
+        
+        vector<unsigned> chunks;
+        for (unsigned k = 0; k < blocks; k++) {
+            unsigned r0 = (unsigned)((unsigned long long)m * order[k] / blocks);
+            unsigned r1 = (unsigned)((unsigned long long)m * (order[k] + 1) / blocks);
+            unsigned c = upper_bound(chunk_ends.begin(), chunk_ends.end(), r0) - chunk_ends.begin();
+            if (!chunks.empty() and chunks.back() == c) {
+                c++;
+            }
+            for (; c < A.num_chunks() and A.chunk_begin(c) < r1; c++) {
+                chunks.push_back(c);
+            }
+        }
+        
+        unsigned k = 0;
+        unsigned r0 = (unsigned)((unsigned long long)m * order[0] / blocks);
+        unsigned r1 = (unsigned)((unsigned long long)m * (order[0] + 1) / blocks);
+        A.for_each(chunks, [&](const RowChunk& chunk) {
+            unsigned chunk_end = chunk.first_row + chunk.num_rows();
+            while (true) {
+                for (unsigned i = max(r0, chunk.first_row); i < min(r1, chunk_end); i++) {
+                    if (row_sums[i] == 0.0) {
+                        continue;
+                    }
+                    SparseVectorView row = chunk.get_row(i - chunk.first_row);
+                    double ax = 0.0;
+                    for (size_t p = 0; p < row.size(); p++) {
+                        ax += row.value(p) * x[row.index(p)];
+                    }
+                    double w = (b[i] - ax) / row_sums[i];
+                    for (size_t p = 0; p < row.size(); p++) {
+                        unsigned j = row.index(p);
+                        if (!touched[j]) {
+                            touched[j] = true;
+                            columns.push_back(j);
+                        }
+                        num[j] += row.value(p) * w;
+                        den[j] += row.value(p);
+                    }
+                }
+                if (r1 > chunk_end) {
+                    return;
+                }
+                
+                // Termino el bloque: se actualizan solo las x_j de las 
+                // columnas que toco y se pasa al siguiente, que puede 
+                // empezar en este mismo bloque del archivo
+                for (unsigned q = 0; q < columns.size(); q++) {
+                    unsigned j = columns[q];
+                    if (den[j] != 0.0) {
+                        x[j] += params.relaxation * num[j] / den[j];
+                    }
+                    num[j] = 0.0;
+                    den[j] = 0.0;
+                    touched[j] = false;
+                }
+                columns.clear();
+                if (++k == blocks) {
+                    return;
+                }
+                r0 = (unsigned)((unsigned long long)m * order[k] / blocks);
+                r1 = (unsigned)((unsigned long long)m * (order[k] + 1) / blocks);
+                if (r0 < chunk.first_row or r0 >= chunk_end) {
+                    return;
+                }
+            }
+        });
+        iterations++;
+        
+        double residual = residual_norm(A, 0, b, x);
+        if (converged(residual, previous, b_norm, params)) {
+            break;
+        }
+        previous = residual;
+    }
+    
+    return x;
+}
+
+vector<Vector> sart(const RowFile& A, const vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const vector<Vector>& x0s)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    Vector sums(A.num_rows());
+    A.for_each([&](const RowChunk& chunk) {
+        for (unsigned i = 0; i < chunk.num_rows(); i++) {
+            SparseVectorView row = chunk.get_row(i);
+            double temp = 0.0;
+            for (size_t p = 0; p < row.size(); p++) {
+                temp += row.value(p);
+            }
+            sums[chunk.first_row + i] = temp;
+        }
+    });
+    
+    vector<Vector> results(bs.size());
+    metrics.num_iterations = 0;
+    
+    for (unsigned k = 0; k < bs.size(); k++) {
+        unsigned iterations;
+        results[k] = sart(A, bs[k], initial_guess(A, x0s, k), sums, params, rand(), iterations);
+        if (iterations > metrics.num_iterations) {
+            metrics.num_iterations = iterations;
+        }
+    }
+    
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    metrics.cond_number = 0.0;
+    metrics.num_eigen_found = 0;
+    
+    return results;
+}
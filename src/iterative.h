@@ -0,0 +1,85 @@
+#ifndef ITERATIVE_H
+#define ITERATIVE_H
+
+#include "vector.h"
+
+template <class T> class BasicSparseMatrix;
+typedef BasicSparseMatrix<double> SparseMatrix;
+class RowFile;
+struct Metrics;
+
+/** Precision de los metodos iterativos. En SINGLE_PRECISION la matriz 
+ *  y los vectores se pasan a float; en MIXED_PRECISION la matriz se 
+ *  guarda en float pero las cuentas se hacen en double, y el residuo 
+ *  se corrige con la matriz original. */
+enum Precision {
+    DOUBLE_PRECISION,
+    SINGLE_PRECISION,
+    MIXED_PRECISION
+};
+
+/** Parametros de los metodos iterativos. */
+struct IterativeParams
+{
+    /** CGLS se detiene cuando ||A^t r|| <= tolerance * ||A^t b||. ART y 
+     *  SART se detienen cuando ||r|| <= tolerance * ||b||, o cuando una 
+     *  pasada reduce ||r|| en menos de tolerance * ||r||. */
+    double tolerance;
+    
+    /** Cantidad maxima de iteraciones por cada vector b (en ART y SART, 
+     *  cada iteracion es una pasada completa por todas las filas). */
+    unsigned max_iterations;
+    
+    /** Factor de relajacion de ART y SART (entre 0 y 2). */
+    double relaxation;
+    
+    /** Si es verdadero, ART recorre las filas (y SART los bloques) en un 
+     *  orden al azar distinto en cada pasada. */
+    bool random_order;
+    
+    /** Cantidad de bloques de filas consecutivas en los que SART divide 
+     *  cada pasada (1 es SART clasico, con una actualizacion por pasada). */
+    unsigned blocks;
+    
+    /** Parametro de Tikhonov de CGLS: con lambda > 0 se resuelve 
+     *  (A^t*A + lambda^2 I) x = A^t*b en lugar de las ecuaciones normales. */
+    double lambda;
+    
+    /** Precision con la que se guardan la matriz y los vectores. */
+    Precision precision;
+    
+    IterativeParams()
+    : tolerance(1e-6), max_iterations(500), relaxation(1.0), random_order(false), blocks(1), lambda(0.0), precision(DOUBLE_PRECISION) {}
+};
+
+/** Resuelve el problema de cuadrados minimos min ||Ax - b|| para 
+ *  cada b de bs con el metodo CGLS (gradientes conjugados sobre las 
+ *  ecuaciones normales), usando solo productos A*x y A^t*y. Nunca 
+ *  se construye A^t*A, por lo que la memoria usada es O(nnz + m + n). 
+ *  Si x0s no esta vacio, x0s[k] es el x inicial para bs[k]; si no, 
+ *  se parte de x = 0. */
+std::vector<Vector> cgls(const SparseMatrix& A, const std::vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const std::vector<Vector>& x0s = std::vector<Vector>());
+
+/** Metodo de Kaczmarz (ART): recorre las filas de A proyectando x 
+ *  sobre el hiperplano de cada ecuacion, partiendo de x0s como CGLS. Usa 
+ *  memoria O(n) ademas de A, y requiere que A tenga la copia CSR. 
+ *  Los distintos b se resuelven en paralelo. */
+std::vector<Vector> art(const SparseMatrix& A, const std::vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const std::vector<Vector>& x0s = std::vector<Vector>());
+
+/** SART: en cada bloque de filas se retroproyecta a la vez el residuo 
+ *  de todas sus ecuaciones, normalizado por las sumas de filas y de 
+ *  columnas de A. Cada actualizacion se calcula en paralelo y el 
+ *  resultado no depende de la cantidad de hilos. Requiere, como ART, 
+ *  la copia CSR de A. El x inicial sale de x0s, como en CGLS. */
+std::vector<Vector> sart(const SparseMatrix& A, const std::vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const std::vector<Vector>& x0s = std::vector<Vector>());
+
+/** CGLS y SART con A guardada por bloques de filas en disco, para las 
+ *  D que no entran en memoria: cada producto por A recorre el archivo 
+ *  leyendo un bloque mientras se procesa el anterior. Dan el mismo 
+ *  resultado que con A en memoria, pero solo en doble precision (se 
+ *  ignora params.precision). */
+std::vector<Vector> cgls(const RowFile& A, const std::vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const std::vector<Vector>& x0s = std::vector<Vector>());
+
+std::vector<Vector> sart(const RowFile& A, const std::vector<Vector>& bs, const IterativeParams& params, Metrics& metrics, const std::vector<Vector>& x0s = std::vector<Vector>());
+
+#endif
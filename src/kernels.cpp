@@ -0,0 +1,440 @@
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+typedef double (*DotKernel)(const double*, const double*, unsigned);
+typedef void (*AxpyKernel)(double, const double*, double*, unsigned);
+typedef void (*GemvKernel)(const double*, size_t, unsigned, unsigned, const double*, double*);
+typedef void (*GemmKernel)(const double*, size_t, const double*, size_t, double*, size_t, unsigned, unsigned, unsigned);
+
+struct Kernels
+{
+    const char* name;
+    DotKernel dot;
+    AxpyKernel axpy;
+    GemvKernel gemv;
+    GemmKernel gemm;
+};
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Escalar ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+static double dot_scalar(const double* x, const double* y, unsigned n)
+{
+    double temp = 0.0;
+    for (unsigned k = 0; k < n; k++) {
+        temp += x[k] * y[k];
+    }
+    return temp;
+}
+
+static void axpy_scalar(double a, const double* x, double* y, unsigned n)
+{
+    for (unsigned k = 0; k < n; k++) {
+        y[k] += a * x[k];
+    }
+}
+
+static void gemv_scalar(const double* A, size_t ld, unsigned rows, unsigned cols, const double* x, double* y)
+{
+    for (unsigned i = 0; i < rows; i++) {
+        const double* a = A + i*ld;
+        double temp = 0.0;
+        for (unsigned k = 0; k < cols; k++) {
+            temp += a[k] * x[k];
+        }
+        y[i] = temp;
+    }
+}
+
+/* Cada fila de C se arma como combinacion lineal de filas de B, para 
+ * que el ciclo interno recorra memoria contigua. */
+static void gemm_scalar(const double* A, size_t lda, const double* B, size_t ldb, double* C, size_t ldc, unsigned rows, unsigned inner, unsigned cols)
+{
+    for (unsigned i = 0; i < rows; i++) {
+        double* c = C + i*ldc;
+        for (unsigned p = 0; p < inner; p++) {
+            double a = A[i*lda + p];
+            const double* b = B + p*ldb;
+            for (unsigned j = 0; j < cols; j++) {
+                c[j] += a * b[j];
+            }
+        }
+    }
+}
+
+
+#ifdef KERNELS_X86
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ AVX2 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+__attribute__((target("avx2,fma")))
+static inline double hsum_avx2(__m256d v)
+{
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    hi = _mm_unpackhi_pd(lo, lo);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, hi));
+}
+
+/* Cuatro acumuladores independientes para no quedar limitados por la 
+ * latencia de la suma. */
+__attribute__((target("avx2,fma")))
+static double dot_avx2(const double* x, const double* y, unsigned n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    unsigned k = 0;
+    for (; k + 16 <= n; k += 16) {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k), _mm256_loadu_pd(y + k), s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k + 4), _mm256_loadu_pd(y + k + 4), s1);
+        s2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k + 8), _mm256_loadu_pd(y + k + 8), s2);
+        s3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k + 12), _mm256_loadu_pd(y + k + 12), s3);
+    }
+    for (; k + 4 <= n; k += 4) {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + k), _mm256_loadu_pd(y + k), s0);
+    }
+    double temp = hsum_avx2(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    for (; k < n; k++) {
+        temp += x[k] * y[k];
+    }
+    return temp;
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(double a, const double* x, double* y, unsigned n)
+{
+    __m256d av = _mm256_set1_pd(a);
+    unsigned k = 0;
+    for (; k + 4 <= n; k += 4) {
+        _mm256_storeu_pd(y + k, _mm256_fmadd_pd(av, _mm256_loadu_pd(x + k), _mm256_loadu_pd(y + k)));
+    }
+    for (; k < n; k++) {
+        y[k] += a * x[k];
+    }
+}
+
+/* Se procesan cuatro filas a la vez para leer cada tramo de x una 
+ * sola vez por cada cuatro filas. */
+__attribute__((target("avx2,fma")))
+static void gemv_avx2(const double* A, size_t ld, unsigned rows, unsigned cols, const double* x, double* y)
+{
+    unsigned i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        const double* a0 = A + i*ld;
+        const double* a1 = a0 + ld;
+        const double* a2 = a1 + ld;
+        const double* a3 = a2 + ld;
+        __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+        __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+        unsigned k = 0;
+        for (; k + 4 <= cols; k += 4) {
+            __m256d xv = _mm256_loadu_pd(x + k);
+            s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a0 + k), xv, s0);
+            s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a1 + k), xv, s1);
+            s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a2 + k), xv, s2);
+            s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a3 + k), xv, s3);
+        }
+        double t0 = hsum_avx2(s0), t1 = hsum_avx2(s1), t2 = hsum_avx2(s2), t3 = hsum_avx2(s3);
+        for (; k < cols; k++) {
+            t0 += a0[k] * x[k];
+            t1 += a1[k] * x[k];
+            t2 += a2[k] * x[k];
+            t3 += a3[k] * x[k];
+        }
+        y[i] = t0;
+        y[i+1] = t1;
+        y[i+2] = t2;
+        y[i+3] = t3;
+    }
+    for (; i < rows; i++) {
+        const double* a = A + i*ld;
+        __m256d s = _mm256_setzero_pd();
+        unsigned k = 0;
+        for (; k + 4 <= cols; k += 4) {
+            s = _mm256_fmadd_pd(_mm256_loadu_pd(a + k), _mm256_loadu_pd(x + k), s);
+        }
+        double t = hsum_avx2(s);
+        for (; k < cols; k++) {
+            t += a[k] * x[k];
+        }
+        y[i] = t;
+    }
+}
+
+/* Mascara para cargar o guardar los primeros n (0 a 4) elementos. */
+__attribute__((target("avx2,fma")))
+static inline __m256i mask_avx2(unsigned n)
+{
+    return _mm256_set_epi64x(n > 3 ? -1 : 0, n > 2 ? -1 : 0, n > 1 ? -1 : 0, n > 0 ? -1 : 0);
+}
+
+/* Bloque de R filas por 8 columnas de C, que se mantiene en registros 
+ * mientras se recorre toda la dimension interna. Las columnas que 
+ * sobran al final se manejan con cargas y guardados enmascarados. */
+template <unsigned R>
+__attribute__((target("avx2,fma")))
+static void gemm_tile_avx2(const double* A, size_t lda, const double* B, size_t ldb, double* C, size_t ldc, unsigned inner, unsigned width)
+{
+    __m256i m0 = mask_avx2(width < 4 ? width : 4);
+    __m256i m1 = mask_avx2(width > 4 ? width - 4 : 0);
+    __m256d c0[R], c1[R];
+    for (unsigned r = 0; r < R; r++) {
+        c0[r] = _mm256_maskload_pd(C + r*ldc, m0);
+        c1[r] = _mm256_maskload_pd(C + r*ldc + 4, m1);
+    }
+    for (unsigned p = 0; p < inner; p++) {
+        __m256d b0 = _mm256_maskload_pd(B + p*ldb, m0);
+        __m256d b1 = _mm256_maskload_pd(B + p*ldb + 4, m1);
+        for (unsigned r = 0; r < R; r++) {
+            __m256d a = _mm256_broadcast_sd(A + r*lda + p);
+            c0[r] = _mm256_fmadd_pd(a, b0, c0[r]);
+            c1[r] = _mm256_fmadd_pd(a, b1, c1[r]);
+        }
+    }
+    for (unsigned r = 0; r < R; r++) {
+        _mm256_maskstore_pd(C + r*ldc, m0, c0[r]);
+        _mm256_maskstore_pd(C + r*ldc + 4, m1, c1[r]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void gemm_avx2(const double* A, size_t lda, const double* B, size_t ldb, double* C, size_t ldc, unsigned rows, unsigned inner, unsigned cols)
+{
+    for (unsigned j = 0; j < cols; j += 8) {
+        unsigned width = cols - j < 8 ? cols - j : 8;
+        unsigned i = 0;
+        for (; i + 4 <= rows; i += 4) {
+            gemm_tile_avx2<4>(A + i*lda, lda, B + j, ldb, C + i*ldc + j, ldc, inner, width);
+        }
+        for (; i < rows; i++) {
+            gemm_tile_avx2<1>(A + i*lda, lda, B + j, ldb, C + i*ldc + j, ldc, inner, width);
+        }
+    }
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ AVX-512 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+/* Se suma a mano en vez de usar _mm512_reduce_add_pd porque en 
+ * algunas versiones de GCC esa funcion (y las extracciones de mitades 
+ * de registro) generan avisos falsos de variables sin inicializar. */
+__attribute__((target("avx512f")))
+static inline double hsum_avx512(__m512d v)
+{
+    double lanes[8] __attribute__((aligned(64)));
+    _mm512_store_pd(lanes, v);
+    return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+__attribute__((target("avx512f")))
+static double dot_avx512(const double* x, const double* y, unsigned n)
+{
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    unsigned k = 0;
+    for (; k + 32 <= n; k += 32) {
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + k), _mm512_loadu_pd(y + k), s0);
+        s1 = _mm512_fmadd_pd(_mm512_loadu_pd(x + k + 8), _mm512_loadu_pd(y + k + 8), s1);
+        s2 = _mm512_fmadd_pd(_mm512_loadu_pd(x + k + 16), _mm512_loadu_pd(y + k + 16), s2);
+        s3 = _mm512_fmadd_pd(_mm512_loadu_pd(x + k + 24), _mm512_loadu_pd(y + k + 24), s3);
+    }
+    for (; k + 8 <= n; k += 8) {
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + k), _mm512_loadu_pd(y + k), s0);
+    }
+    if (k < n) {
+        __mmask8 mask = (__mmask8)((1u << (n - k)) - 1);
+        s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, x + k), _mm512_maskz_loadu_pd(mask, y + k), s1);
+    }
+    return hsum_avx512(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+}
+
+__attribute__((target("avx512f")))
+static void axpy_avx512(double a, const double* x, double* y, unsigned n)
+{
+    __m512d av = _mm512_set1_pd(a);
+    unsigned k = 0;
+    for (; k + 8 <= n; k += 8) {
+        _mm512_storeu_pd(y + k, _mm512_fmadd_pd(av, _mm512_loadu_pd(x + k), _mm512_loadu_pd(y + k)));
+    }
+    if (k < n) {
+        __mmask8 mask = (__mmask8)((1u << (n - k)) - 1);
+        __m512d yv = _mm512_fmadd_pd(av, _mm512_maskz_loadu_pd(mask, x + k), _mm512_maskz_loadu_pd(mask, y + k));
+        _mm512_mask_storeu_pd(y + k, mask, yv);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void gemv_avx512(const double* A, size_t ld, unsigned rows, unsigned cols, const double* x, double* y)
+{
+    unsigned tail = cols % 8;
+    __mmask8 mask = (__mmask8)((1u << tail) - 1);
+    unsigned i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        const double* a0 = A + i*ld;
+        const double* a1 = a0 + ld;
+        const double* a2 = a1 + ld;
+        const double* a3 = a2 + ld;
+        __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+        __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+        unsigned k = 0;
+        for (; k + 8 <= cols; k += 8) {
+            __m512d xv = _mm512_loadu_pd(x + k);
+            s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a0 + k), xv, s0);
+            s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a1 + k), xv, s1);
+            s2 = _mm512_fmadd_pd(_mm512_loadu_pd(a2 + k), xv, s2);
+            s3 = _mm512_fmadd_pd(_mm512_loadu_pd(a3 + k), xv, s3);
+        }
+        if (tail != 0) {
+            __m512d xv = _mm512_maskz_loadu_pd(mask, x + k);
+            s0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a0 + k), xv, s0);
+            s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a1 + k), xv, s1);
+            s2 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a2 + k), xv, s2);
+            s3 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a3 + k), xv, s3);
+        }
+        y[i] = hsum_avx512(s0);
+        y[i+1] = hsum_avx512(s1);
+        y[i+2] = hsum_avx512(s2);
+        y[i+3] = hsum_avx512(s3);
+    }
+    for (; i < rows; i++) {
+        const double* a = A + i*ld;
+        __m512d s = _mm512_setzero_pd();
+        unsigned k = 0;
+        for (; k + 8 <= cols; k += 8) {
+            s = _mm512_fmadd_pd(_mm512_loadu_pd(a + k), _mm512_loadu_pd(x + k), s);
+        }
+        if (tail != 0) {
+            s = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a + k), _mm512_maskz_loadu_pd(mask, x + k), s);
+        }
+        y[i] = hsum_avx512(s);
+    }
+}
+
+/* Igual que en AVX2, pero con bloques de R filas por 16 columnas. */
+template <unsigned R>
+__attribute__((target("avx512f")))
+static void gemm_tile_avx512(const double* A, size_t lda, const double* B, size_t ldb, double* C, size_t ldc, unsigned inner, unsigned width)
+{
+    __mmask8 m0 = (__mmask8)(width >= 8 ? 0xFF : (1u << width) - 1);
+    __mmask8 m1 = (__mmask8)(width >= 16 ? 0xFF : width > 8 ? (1u << (width - 8)) - 1 : 0);
+    __m512d c0[R], c1[R];
+    for (unsigned r = 0; r < R; r++) {
+        c0[r] = _mm512_maskz_loadu_pd(m0, C + r*ldc);
+        c1[r] = _mm512_maskz_loadu_pd(m1, C + r*ldc + 8);
+    }
+    for (unsigned p = 0; p < inner; p++) {
+        __m512d b0 = _mm512_maskz_loadu_pd(m0, B + p*ldb);
+        __m512d b1 = _mm512_maskz_loadu_pd(m1, B + p*ldb + 8);
+        for (unsigned r = 0; r < R; r++) {
+            __m512d a = _mm512_set1_pd(A[r*lda + p]);
+            c0[r] = _mm512_fmadd_pd(a, b0, c0[r]);
+            c1[r] = _mm512_fmadd_pd(a, b1, c1[r]);
+        }
+    }
+    for (unsigned r = 0; r < R; r++) {
+        _mm512_mask_storeu_pd(C + r*ldc, m0, c0[r]);
+        _mm512_mask_storeu_pd(C + r*ldc + 8, m1, c1[r]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void gemm_avx512(const double* A, size_t lda, const double* B, size_t ldb, double* C, size_t ldc, unsigned rows, unsigned inner, unsigned cols)
+{
+    for (unsigned j = 0; j < cols; j += 16) {
+        unsigned width = cols - j < 16 ? cols - j : 16;
+        unsigned i = 0;
+        for (; i + 4 <= rows; i += 4) {
+            gemm_tile_avx512<4>(A + i*lda, lda, B + j, ldb, C + i*ldc + j, ldc, inner, width);
+        }
+        for (; i < rows; i++) {
+            gemm_tile_avx512<1>(A + i*lda, lda, B + j, ldb, C + i*ldc + j, ldc, inner, width);
+        }
+    }
+}
+
+#endif
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Seleccion ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+static const Kernels scalar_kernels = {"scalar", dot_scalar, axpy_scalar, gemv_scalar, gemm_scalar};
+#ifdef KERNELS_X86
+static const Kernels avx2_kernels = {"avx2", dot_avx2, axpy_avx2, gemv_avx2, gemm_avx2};
+static const Kernels avx512_kernels = {"avx512", dot_avx512, axpy_avx512, gemv_avx512, gemm_avx512};
+#endif
+
+static const Kernels* best_kernels()
+{
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return &avx512_kernels;
+    }
+    if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma")) {
+        return &avx2_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+static const Kernels*& current_kernels()
+{
+    static const Kernels* kernels = best_kernels();
+    return kernels;
+}
+
+const char* simd_level()
+{
+    return current_kernels()->name;
+}
+
+bool set_simd_level(const string& level)
+{
+    if (level == "auto") {
+        current_kernels() = best_kernels();
+        return true;
+    }
+    if (level == "scalar") {
+        current_kernels() = &scalar_kernels;
+        return true;
+    }
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (level == "avx2" and __builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma")) {
+        current_kernels() = &avx2_kernels;
+        return true;
+    }
+    if (level == "avx512" and __builtin_cpu_supports("avx512f")) {
+        current_kernels() = &avx512_kernels;
+        return true;
+    }
+#endif
+    return false;
+}
+
+double dot(const double* x, const double* y, unsigned n)
+{
+    return current_kernels()->dot(x, y, n);
+}
+
+void axpy(double a, const double* x, double* y, unsigned n)
+{
+    current_kernels()->axpy(a, x, y, n);
+}
+
+void gemv(const double* A, size_t ld, unsigned rows, unsigned cols, const double* x, double* y)
+{
+    current_kernels()->gemv(A, ld, rows, cols, x, y);
+}
+
+void gemm_block(const double* A, size_t lda, const double* B, size_t ldb, double* C, size_t ldc, unsigned rows, unsigned inner, unsigned cols)
+{
+    current_kernels()->gemm(A, lda, B, ldb, C, ldc, rows, inner, cols);
+}
@@ -0,0 +1,33 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <string>
+
+/* Nucleos densos usados por Matrix. Cada uno tiene una version AVX-512, 
+ * una AVX2 (con FMA) y una escalar; la que se usa se elige una sola vez 
+ * en tiempo de ejecucion segun lo que soporte el procesador. Las 
+ * matrices se guardan por filas, y ld es la distancia (en elementos) 
+ * entre el comienzo de dos filas consecutivas. */
+
+/** Version de los nucleos en uso: "avx512", "avx2" o "scalar". */
+const char* simd_level();
+
+/** Fuerza una version de los nucleos ("auto" vuelve a elegir segun 
+ *  el procesador). Devuelve falso si el nombre no es valido o si el 
+ *  procesador no la soporta. */
+bool set_simd_level(const std::string& level);
+
+/** Producto interno entre x e y, de n elementos. */
+double dot(const double* x, const double* y, unsigned n);
+
+/** y += a*x, con x e y de n elementos. */
+void axpy(double a, const double* x, double* y, unsigned n);
+
+/** y = A*x, con A de rows x cols. */
+void gemv(const double* A, size_t ld, unsigned rows, unsigned cols, const double* x, double* y);
+
+/** C += A*B, con A de rows x inner, B de inner x cols y C de rows x cols. */
+void gemm_block(const double* A, size_t lda, const double* B, size_t ldb, double* C, size_t ldc, unsigned rows, unsigned inner, unsigned cols);
+
+#endif
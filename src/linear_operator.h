@@ -0,0 +1,103 @@
+#ifndef LINEAR_OPERATOR_H
+#define LINEAR_OPERATOR_H
+
+#include "vector.h"
+#include "matrix.h"
+#include "sparse_matrix.h"
+#include "kernels.h"
+
+/** Operador lineal simetrico de n x n del que solo se sabe 
+ *  calcular el producto por un vector. */
+class LinearOperator
+{
+
+public:
+
+    virtual ~LinearOperator() {}
+    
+    virtual unsigned size() const = 0;
+    
+    /** Calcula y = Op*x. */
+    virtual void apply(const Vector& x, Vector& y) const = 0;
+
+};
+
+/** Operador dado por una matriz densa ya armada (por ejemplo D^t*D). */
+class DenseOperator : public LinearOperator
+{
+
+public:
+
+    DenseOperator(const Matrix& A) : _A(A) {}
+    
+    unsigned size() const {
+        return _A.num_rows();
+    }
+    
+    void apply(const Vector& x, Vector& y) const {
+        y = _A*x;
+    }
+    
+private:
+
+    const Matrix& _A;
+
+};
+
+/** Operador D^t*D aplicado sin armarlo, como D^t*(D*x). */
+class NormalOperator : public LinearOperator
+{
+
+public:
+
+    NormalOperator(const SparseMatrix& D) : _D(D) {}
+    
+    unsigned size() const {
+        return _D.num_columns();
+    }
+    
+    void apply(const Vector& x, Vector& y) const {
+        y = transposed_product(_D, _D*x);
+    }
+    
+private:
+
+    const SparseMatrix& _D;
+
+};
+
+/** Operador A - sum_k l_k v_k v_k^t, donde (l_k, v_k) son los pares 
+ *  de A ya hallados. Se aplica como A*x - sum_k l_k (v_k^t x) v_k, sin 
+ *  copiar ni modificar A. Guarda referencias a los autovalores y 
+ *  autovectores, asi que cada par que se agregue a esos vectores 
+ *  queda deflacionado a partir del siguiente producto. */
+class DeflatedOperator : public LinearOperator
+{
+
+public:
+
+    DeflatedOperator(const LinearOperator& A, const std::vector<double>& evalues, const std::vector<Vector>& evectors)
+    : _A(A), _evalues(evalues), _evectors(evectors) {}
+    
+    unsigned size() const {
+        return _A.size();
+    }
+    
+    void apply(const Vector& x, Vector& y) const {
+        _A.apply(x, y);
+        for (unsigned k = 0; k < _evalues.size(); k++) {
+            const Vector& v = _evectors[k];
+            double c = _evalues[k] * dot(&v[0], &x[0], x.size());
+            axpy(-c, &v[0], &y[0], y.size());
+        }
+    }
+    
+private:
+
+    const LinearOperator& _A;
+    const std::vector<double>& _evalues;
+    const std::vector<Vector>& _evectors;
+
+};
+
+#endif
@@ -1,51 +1,311 @@
 #include "sparse_matrix.h"
+#include "eigen.h"
+#include "iterative.h"
 #include "metrics.h"
+#include "parallel.h"
+#include "tracer.h"
+#include "cache.h"
+#include "factorization.h"
+#include "kernels.h"
+#include "fbp.h"
+#include "image_io.h"
+#include "geometry.h"
+#include "pixel_tracer.h"
+#include "row_file.h"
+#include "random.h"
 
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
+#include <cstdint>
 #include <ctime>
 #include <fstream>
 #include <iostream>
-#include <limits>
-#include <sstream>
 
 #include "debug.h"
 
 using namespace std;
 
-typedef vector<vector<unsigned char> > Image;
+/* Cantidad de rayos que cada hilo le pide a la geometria por vez. */
+static const unsigned RAY_BATCH = 1024;
 
-static const double epsilon = numeric_limits<double>::epsilon();
+enum Tracer {
+    PIXEL_TRACER,
+    EXACT_TRACER
+};
 
 struct SimulationData
 {
-    Image image;
+    ImageBuffer image;
     unsigned cell_size;
     unsigned discr_size;
-    unsigned method;
+    GeometryParams geometry;
     vector<double> noise_levels;
+    Tracer tracer;
+    unsigned seed;
+    string cache_dir;
+};
+
+enum Solver {
+    SVD,
+    CGLS,
+    ART,
+    SART,
+    FBP
+};
+
+struct Options
+{
+    Solver solver;
+    IterativeParams iterative;
+    EigenParams eigen;
+    Regularization regularization;
+    FbpFilter filter;
+    Tracer tracer;
+    unsigned seed;
+    string cache_dir;
+    unsigned levels;
+    GeometryParams geometry;
+    size_t stream_budget;
+    
+    Options() : solver(SVD), filter(RAM_LAK), tracer(PIXEL_TRACER), seed(1000), levels(1), stream_budget(0) {}
 };
 
-bool load_csv_image(const string& filename, Image& image)
+/* Interpreta un argumento de la forma --nombre=valor. Devuelve 
+ * falso si el argumento no es una opcion valida. */
+bool parse_option(const string& arg, Options& opts)
 {
-    ifstream ifile(filename);
-    if (ifile.fail()) {
+    size_t pos = arg.find('=');
+    if (pos == string::npos) {
         return false;
     }
-
-    string line;
-    while (getline(ifile, line)) {
-        image.push_back(vector<unsigned char>());
-        stringstream ss(line);
-        string number;
-        while (getline(ss, number, ',')) {
-            image.back().push_back(stoi(number));
+    string name = arg.substr(2, pos - 2);
+    string value = arg.substr(pos + 1);
+    
+    if (name == "solver") {
+        if (value == "svd") {
+            opts.solver = SVD;
+        }
+        else if (value == "cgls") {
+            opts.solver = CGLS;
+        }
+        else if (value == "art") {
+            opts.solver = ART;
+        }
+        else if (value == "sart") {
+            opts.solver = SART;
+        }
+        else if (value == "fbp") {
+            opts.solver = FBP;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "tol") {
+        opts.iterative.tolerance = atof(value.c_str());
+    }
+    else if (name == "max-iter") {
+        opts.iterative.max_iterations = stoi(value);
+    }
+    else if (name == "lambda") {
+        if (value == "gcv") {
+            opts.regularization.automatic = true;
+        }
+        else {
+            opts.regularization.automatic = false;
+            opts.regularization.lambda = atof(value.c_str());
+            opts.iterative.lambda = opts.regularization.lambda;
+        }
+    }
+    else if (name == "filter") {
+        if (value == "ram-lak") {
+            opts.filter = RAM_LAK;
+        }
+        else if (value == "shepp-logan") {
+            opts.filter = SHEPP_LOGAN;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "relax") {
+        opts.iterative.relaxation = atof(value.c_str());
+    }
+    else if (name == "order") {
+        if (value == "sequential") {
+            opts.iterative.random_order = false;
+        }
+        else if (value == "random") {
+            opts.iterative.random_order = true;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "blocks") {
+        opts.iterative.blocks = stoi(value);
+    }
+    else if (name == "precision") {
+        if (value == "double") {
+            opts.iterative.precision = DOUBLE_PRECISION;
+        }
+        else if (value == "single") {
+            opts.iterative.precision = SINGLE_PRECISION;
+        }
+        else if (value == "mixed") {
+            opts.iterative.precision = MIXED_PRECISION;
+        }
+        else {
+            return false;
         }
     }
+    else if (name == "levels") {
+        opts.levels = stoi(value);
+        if (opts.levels == 0) {
+            return false;
+        }
+    }
+    else if (name == "eigen") {
+        if (value == "power") {
+            opts.eigen.method = POWER_METHOD;
+        }
+        else if (value == "lanczos") {
+            opts.eigen.method = LANCZOS;
+        }
+        else if (value == "randomized") {
+            opts.eigen.method = RANDOMIZED;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "ata") {
+        if (value == "dense") {
+            opts.eigen.matrix_free = false;
+        }
+        else if (value == "implicit") {
+            opts.eigen.matrix_free = true;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "eig-tol") {
+        opts.eigen.tolerance = atof(value.c_str());
+    }
+    else if (name == "rank") {
+        opts.eigen.max_eigen = stoi(value);
+    }
+    else if (name == "oversample") {
+        opts.eigen.oversampling = stoi(value);
+    }
+    else if (name == "power-iter") {
+        opts.eigen.power_iterations = stoi(value);
+    }
+    else if (name == "tracer") {
+        if (value == "exact") {
+            opts.tracer = EXACT_TRACER;
+        }
+        else if (value == "pixel") {
+            opts.tracer = PIXEL_TRACER;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "angles") {
+        opts.geometry.angles = stoi(value);
+        if (opts.geometry.angles == 0) {
+            return false;
+        }
+    }
+    else if (name == "detectors") {
+        opts.geometry.detectors = stoi(value);
+        if (opts.geometry.detectors == 0) {
+            return false;
+        }
+    }
+    else if (name == "source-distance") {
+        opts.geometry.source_distance = atof(value.c_str());
+        if (!(opts.geometry.source_distance > 0.0)) {
+            return false;
+        }
+    }
+    else if (name == "seed") {
+        opts.seed = stoi(value);
+    }
+    else if (name == "cache") {
+        opts.cache_dir = value;
+    }
+    else if (name == "stream") {
+        opts.stream_budget = (size_t)stoul(value) << 20;
+        if (opts.stream_budget == 0) {
+            return false;
+        }
+    }
+    else if (name == "threads") {
+        set_num_threads(stoi(value));
+    }
+    else if (name == "simd") {
+        return set_simd_level(value);
+    }
+    else {
+        return false;
+    }
+    
+    return true;
+}
 
+/* Interpreta el parametro <metodo>: 0, 1 o 2 para los metodos fijos, 
+ * parallel o fan para los tomografos, o la cantidad de rayos 
+ * aleatorios. Devuelve falso si no es ninguno de esos. */
+bool parse_method(const string& arg, GeometryParams& params)
+{
+    if (arg == "parallel") {
+        params.type = PARALLEL_BEAM;
+        return true;
+    }
+    else if (arg == "fan") {
+        params.type = FAN_BEAM;
+        return true;
+    }
+    if (arg.empty() or arg.find_first_not_of("0123456789") != string::npos) {
+        return false;
+    }
+    
+    unsigned method = stoi(arg);
+    if (method == 0) {
+        params.type = FULL_GEOMETRY;
+    }
+    else if (method == 1) {
+        params.type = AXIS_GEOMETRY;
+    }
+    else if (method == 2) {
+        params.type = CORNER_GEOMETRY;
+    }
+    else {
+        params.type = RANDOM_GEOMETRY;
+        params.num_rays = method;
+    }
     return true;
 }
 
+/* El parametro <metodo> que corresponde a la geometria. */
+string method_name(const GeometryParams& params)
+{
+    switch (params.type) {
+    case PARALLEL_BEAM:
+        return "parallel";
+    case FAN_BEAM:
+        return "fan";
+    case RANDOM_GEOMETRY:
+        return to_string(params.num_rays);
+    default:
+        return to_string((unsigned)params.type);
+    }
+}
+
 unsigned char convert_to_pixel(double x)
 {
     if (x > 255.0) {
@@ -58,55 +318,48 @@ unsigned char convert_to_pixel(double x)
     return (unsigned char)x;
 }
 
-vector<Image> convert_to_images(const vector<Vector>& s, unsigned rowsize)
+ImageBuffer convert_to_image(const Vector& s, unsigned rowsize)
 {
-    vector<Image> res(s.size(), Image(rowsize, vector<unsigned char>(rowsize)));
-    for (unsigned k = 0; k < s.size(); k++) {
-        for (unsigned i = 0; i < rowsize; i++) {
-            for (unsigned j = 0; j < rowsize; j++) {
-                res[k][i][j] = convert_to_pixel(s[k][i*rowsize + j]);
-            }
-        }
+    ImageBuffer res(rowsize, rowsize);
+    unsigned char* pixels = res.data();
+    for (unsigned k = 0; k < rowsize * rowsize; k++) {
+        pixels[k] = convert_to_pixel(s[k]);
     }
     return res;
 }
 
-Image scale(const Image& img, unsigned size, unsigned cell_size)
+/* PSNR de la reconstruccion s (un valor por celda) contra la imagen 
+ * original, sin armar la imagen reconstruida ni su version ampliada: 
+ * cada pixel se compara directamente con el valor de su celda, llevado 
+ * a [0,255] como en convert_to_pixel. Los valores de cada fila de 
+ * celdas se convierten una sola vez, y el error se acumula en un 
+ * entero, asi que el resultado es exacto. */
+double get_psnr(const Vector& s, const SimulationData& sd)
 {
-    Image res(size, vector<unsigned char>(size));
-    for (unsigned i = 0; i < size; i++) {
-        for (unsigned j = 0; j < size; j++) {
-            res[i][j] = img[i/cell_size][j/cell_size];
-        }
-    }
-    return res;
-}
-
-double get_psnr(const Image& img1, const Image& img2)
-{
-    unsigned n = img1.size();
-    double ecm = 0.0;
+    unsigned n = sd.image.size();
+    vector<unsigned char> cells(sd.discr_size);
+    unsigned long long ecm = 0;
     for (unsigned i = 0; i < n; i++) {
+        if (i % sd.cell_size == 0) {
+            for (unsigned c = 0; c < sd.discr_size; c++) {
+                cells[c] = convert_to_pixel(s[(i / sd.cell_size) * sd.discr_size + c]);
+            }
+        }
+        const unsigned char* row = sd.image.data() + (size_t)i * n;
         for (unsigned j = 0; j < n; j++) {
-            ecm += (img1[i][j] - img2[i][j])*(img1[i][j] - img2[i][j]);
+            int diff = (int)cells[j / sd.cell_size] - (int)row[j];
+            ecm += diff * diff;
         }
     }
-    ecm /= n*n;
     
-    return 10.0 * log10((255.0*255.0) / ecm);
+    return 10.0 * log10((255.0*255.0) / ((double)ecm / ((double)n*n)));
 }
 
-void save_as_csv_image(const string& filename, const Image& img)
+/* Cantidad de celdas por lado de una imagen de image_size pixeles 
+ * (la ultima celda puede quedar incompleta). */
+unsigned discretization_size(unsigned image_size, unsigned cell_size)
 {
-    ofstream ofile(filename);
-
-    for (unsigned i = 0; i < img.size(); i++) {
-        ofile << (unsigned)(img[i][0]);
-        for (unsigned j = 1; j < img[i].size(); j++) {
-            ofile << ", " << (unsigned)(img[i][j]);
-        }
-        ofile << endl;
-    }
+    return (image_size + cell_size - 1) / cell_size;
 }
 
 unsigned celda(unsigned x, unsigned y, const SimulationData& sd)
@@ -114,300 +367,450 @@ unsigned celda(unsigned x, unsigned y, const SimulationData& sd)
     return ((y/sd.cell_size) * sd.discr_size + x / sd.cell_size);
 }
 
-void simulate_ray
-(
-    const SimulationData& sd,
-    unsigned ray_index,
-    unsigned x0,
-    unsigned y0,
-    unsigned x1,
-    unsigned y1,
-    SparseMatrix& D,
-    vector<Vector>& ts
-)
+/* Acumula el tiempo de un rayo (la suma de los pixeles que visita) y 
+ * su fila de D a medida que se le pasan sus pixeles. Como los pixeles 
+ * de cada celda llegan seguidos, basta con acumular la distancia de la 
+ * celda actual y emitirla al pasar a otra, sin ningun buffer del tamaño 
+ * de la discretizacion. Si hits es nulo solo se calcula el tiempo. */
+struct RayAccumulator
 {
-    double time = 0.0;
-    vector<double> distances(sd.discr_size*sd.discr_size);
-    
-    // Un rayo se representa con una funcion lineal y=ax+b, donde el eje y va de arriba hacia abajo
-    // La funcion lineal debe pasar por los centros de los pixeles (x0,y0) y (x1,y1)
-    
-    // Coordenadas exactas de los puntos por donde pasa la funcion:
-    double x0d = x0 + 0.5;
-    double y0d = y0 + 0.5;
-    double x1d = x1 + 0.5;
-    double y1d = y1 + 0.5;
-    
-    unsigned posx;
-    unsigned posy;
-    if (x0 < x1) {
-        posx = x0;
-        posy = y0;
-    }
-    else if (x1 < x0) {
-        posx = x1;
-        posy = y1;
-    }
-    else {
-        // Si el rayo es vertical, lo "torcemos" un poco
-        // Por convencion empezamos en el pixel (x0,y0)
-        posx = x0;
-        posy = y0;
-        x0d -= 0.25;
-        x1d += 0.25;
-    }
+    const SimulationData& sd;
+    unsigned ray_index;
+    vector<Triplet>* hits;
+    double time;
+    unsigned current_cell;
+    double current_distance;
     
-    // Determinamos los coeficientes de la funcion
-    double a = (y1d - y0d)/(x1d - x0d);
-    double b = y0d - a*x0d;
+    RayAccumulator(const SimulationData& sd, unsigned ray_index, vector<Triplet>* hits)
+    : sd(sd), ray_index(ray_index), hits(hits), time(0.0), current_cell(0), current_distance(0.0) {}
     
-    
-    while (posx < sd.image.size() && posy < sd.image.size()) { //mientras no me salga de la imagen
-
-        double actual = (double)(sd.image[posy][posx]);
-
-        //sumo actual + 1 al tiempo total de este rayo k
-        time += actual;
+    void visit(unsigned x, unsigned y) {
+        //sumo el valor del pixel al tiempo total de este rayo
+        time += (double)(sd.image(y, x));
 
         //ahora sumo uno a la distancia en esta celda
-        distances[celda(posx, posy, sd)] += 1.0;
-
-        double derecha = a*((double)(posx + 1)) + b; //evaluo en el borde derecho del pixel actual
-
-        if (fabs(derecha - (double)posy) < epsilon) {
-            posy--;
-            posx++;
-        }
-        else if (fabs(derecha - (double)(posy+1)) < epsilon) {
-            posx++;
-            posy++;
-        }
-        else if (derecha < (double)posy) {
-            posy--;
-        }
-        else if ((double)posy < derecha && derecha < (double)(posy + 1)) {
-            posx++;
-        }
-        else { // if ((double)(posy + 1) < derecha)
-            posy++;
+        unsigned cell = celda(x, y, sd);
+        if (cell != current_cell and current_distance != 0.0 and hits != 0) {
+            hits->push_back(Triplet(ray_index, current_cell, current_distance));
+            current_distance = 0.0;
         }
+        current_cell = cell;
+        current_distance += 1.0;
     }
     
-    for (unsigned j = 0; j < D.num_columns(); j++) {
-        if (distances[j] != 0.0) {
-            D.get_column(j).push_back(make_pair(ray_index, distances[j]));
+    /* Emite la ultima celda y devuelve el tiempo. */
+    double finish() {
+        if (current_distance != 0.0 and hits != 0) {
+            hits->push_back(Triplet(ray_index, current_cell, current_distance));
         }
+        return time;
     }
+};
 
-    // Guardamos los tiempos tardados (agregando ruido)
-    for (unsigned i = 0; i < ts.size(); i++) {
-        double noise = ((2.0*sd.noise_levels[i])/RAND_MAX)*rand() - sd.noise_levels[i];
-        ts[i][ray_index] = (time + noise) >= 0.0 ? time + noise : 0.0;
+/* Cuerda de la imagen sobre la recta del rayo, recortada a los bordes 
+ * de la imagen. Para los rayos entre centros de pixeles, como siempre 
+ * parten de un borde, es el mismo tramo que recorre PixelTracer. */
+bool ray_chord(const SimulationData& sd, const Line& line, double& x0, double& y0, double& x1, double& y1)
+{
+    x0 = line.x0;
+    y0 = line.y0;
+    x1 = line.x1;
+    y1 = line.y1;
+    return clip_line(x0, y0, x1, y1, sd.image.size());
+}
+
+/* Trazado por pixeles de un rayo cualquiera (de los tomografos, que no 
+ * pasan por centros de pixeles): se recorren los pixeles que corta la 
+ * cuerda, sumando 1 por cada uno como en PixelTracer. */
+double simulate_line(const SimulationData& sd, unsigned ray_index, const Line& line, vector<Triplet>* hits)
+{
+    RayAccumulator acc(sd, ray_index, hits);
+    double x0, y0, x1, y1;
+    if (ray_chord(sd, line, x0, y0, x1, y1)) {
+        trace_grid(x0, y0, x1, y1, 1.0, sd.image.size(), [&acc](unsigned i, unsigned j, double) {
+            acc.visit(i, j);
+        });
     }
+    return acc.finish();
 }
 
-enum Direction {
-    UP_LEFT,
-    UP_RIGHT,
-    DOWN_LEFT,
-    DOWN_RIGHT
-};
+/* Tiempo exacto del rayo: la integral de la imagen sobre la cuerda, 
+ * recorriendo pixel por pixel. */
+double exact_ray_time(const SimulationData& sd, const Line& line)
+{
+    double x0, y0, x1, y1;
+    if (!ray_chord(sd, line, x0, y0, x1, y1)) {
+        return 0.0;
+    }
+    
+    double time = 0.0;
+    trace_grid(x0, y0, x1, y1, 1.0, sd.image.size(), [&](unsigned i, unsigned j, double length) {
+        time += sd.image(j, i) * length;
+    });
+    return time;
+}
 
-/* Esto es para generar un rayo diagonal de pendiente 1 sin 
- * complicarse la vida.
- * Hace "trampa" porque llama a simulate_ray con un pixel que 
- * no va a estar en el borde de la imagen, pero funciona. */
-void simulate_ray
-(
-    const SimulationData& sd,
-    unsigned ray_index,
-    unsigned x0,
-    unsigned y0,
-    Direction dir,
-    SparseMatrix& D,
-    vector<Vector>& ts
-)
+/* Fila ray_index de D con las longitudes exactas del rayo dentro de 
+ * cada celda. Recorre directamente la grilla de celdas, asi que el 
+ * costo es proporcional a discr_size y no al tamaño de la imagen. */
+void exact_ray_cells(const SimulationData& sd, unsigned ray_index, const Line& line, vector<Triplet>& hits)
 {
-    switch (dir) {
-    case UP_LEFT:
-        simulate_ray(sd, ray_index, x0, y0, x0 - 1, y0 - 1, D, ts);
-        break;
-    case UP_RIGHT:
-        simulate_ray(sd, ray_index, x0, y0, x0 + 1, y0 - 1, D, ts);
-        break;
-    case DOWN_LEFT:
-        simulate_ray(sd, ray_index, x0, y0, x0 - 1, y0 + 1, D, ts);
-        break;
-    case DOWN_RIGHT:
-        simulate_ray(sd, ray_index, x0, y0, x0 + 1, y0 + 1, D, ts);
-        break;
-    default:
-        break;
+    double x0, y0, x1, y1;
+    if (!ray_chord(sd, line, x0, y0, x1, y1)) {
+        return;
+    }
+    
+    trace_grid(x0, y0, x1, y1, sd.cell_size, sd.discr_size, [&](unsigned i, unsigned j, double length) {
+        hits.push_back(Triplet(ray_index, j * sd.discr_size + i, length));
+    });
+}
+
+GeometryKey geometry_key(const SimulationData& sd)
+{
+    GeometryKey key;
+    key.image_size = sd.image.size();
+    key.cell_size = sd.cell_size;
+    key.geometry = sd.geometry.type;
+    key.tracer = sd.tracer;
+    key.seed = sd.seed;
+    key.num_rays = sd.geometry.num_rays;
+    key.angles = sd.geometry.angles;
+    key.detectors = sd.geometry.detectors;
+    key.reserved = 0;
+    key.source_distance = sd.geometry.source_distance;
+    return key;
+}
+
+/* Traza los rayos [begin, end) de la geometria. Los rayos salen de la 
+ * geometria de a tandas de RAY_BATCH, que cada hilo pide y traza sobre 
+ * la marcha, sin armar nunca la lista de todos los rayos. Cada hilo 
+ * traza un bloque contiguo de rayos, guardando los elementos de D en 
+ * su propio buffer (*hits)[t] y los tiempos en sus propias posiciones 
+ * de times. Como los bloques estan en orden de rayo, al juntar los 
+ * buffers en orden las filas de cada columna de D quedan ordenadas, y 
+ * D no depende de la cantidad de hilos. Los rayos que pasan por centros 
+ * de pixeles se trazan con PixelTracer, varios a la vez; los demas, con 
+ * trace_grid. Si hits es nulo solo se calculan los tiempos. */
+void trace_rays(const SimulationData& sd, const Geometry& geometry, const PixelTracer& tracer, unsigned begin, unsigned end, Vector& times, vector<vector<Triplet> >* hits)
+{
+    const PixelGeometry* pixel = geometry.pixel_geometry();
+    unsigned threads = num_threads();
+    parallel_for(end - begin, [&](unsigned t, unsigned thread_begin, unsigned thread_end) {
+        vector<Triplet>* buffer = hits != 0 ? &(*hits)[t] : 0;
+        vector<Ray> rays;
+        vector<Line> lines;
+        for (unsigned first = begin + thread_begin; first < begin + thread_end; first += RAY_BATCH) {
+            unsigned last = min(first + RAY_BATCH, begin + thread_end);
+            if (sd.tracer == PIXEL_TRACER and pixel != 0) {
+                pixel->rays(first, last, rays);
+                tracer.trace(rays.data(), last - first, first, &times[first], buffer);
+                continue;
+            }
+            
+            geometry.lines(first, last, lines);
+            for (unsigned r = first; r < last; r++) {
+                const Line& line = lines[r - first];
+                if (sd.tracer == EXACT_TRACER) {
+                    times[r] = exact_ray_time(sd, line);
+                    if (buffer != 0) {
+                        exact_ray_cells(sd, r, line, *buffer);
+                    }
+                }
+                else {
+                    times[r] = simulate_line(sd, r, line, buffer);
+                }
+            }
+        }
+    }, threads);
+}
+
+/* Guarda en ts los tiempos con ruido, en una pasada aparte por cada 
+ * nivel de ruido sobre los tiempos sin ruido. El ruido uniforme en 
+ * [-nivel, nivel] de cada rayo sale del generador basado en contador 
+ * (con el rayo y el indice del nivel como contador; cada llamada da 
+ * los numeros de cuatro rayos seguidos), asi que tampoco depende del 
+ * reparto entre hilos ni del orden. */
+void add_noise(const SimulationData& sd, const Vector& times, vector<Vector>& ts)
+{
+    unsigned num_rays = times.size();
+    unsigned groups = (num_rays + 3) / 4;
+    for (unsigned i = 0; i < ts.size(); i++) {
+        ts[i].resize(num_rays);
+        double level = sd.noise_levels[i];
+        Vector& t = ts[i];
+        parallel_for(groups, [&](unsigned, unsigned begin, unsigned end) {
+            for (unsigned g = begin; g < end; g++) {
+                double u[4];
+                random_uniform4(sd.seed, g, i, NOISE_STREAM, u);
+                for (unsigned k = 0; k < 4 and 4*g + k < num_rays; k++) {
+                    unsigned r = 4*g + k;
+                    double noisy = times[r] + level * (2.0*u[k] - 1.0);
+                    t[r] = noisy >= 0.0 ? noisy : 0.0;
+                }
+            }
+        });
     }
 }
 
-void simulate(const SimulationData& sd, SparseMatrix& D, vector<Vector>& ts)
+/* Traza todos los rayos (ver trace_rays) y arma D en memoria.
+ *
+ * Si hay un directorio de cache y ya tiene la D de esta geometria, se 
+ * mapea el archivo y solo se calculan los tiempos. Si no, D se guarda 
+ * ahi para las proximas corridas.
+ *
+ * Con with_matrix en falso solo se calculan los tiempos (D queda 
+ * vacia), para los metodos que no la usan. */
+void simulate(const SimulationData& sd, SparseMatrix& D, vector<Vector>& ts, bool with_matrix = true)
 {
     cout << "Simulando tomografia..." << endl;
     
     unsigned num_cells = sd.discr_size * sd.discr_size;
-    unsigned imgsize = sd.image.size();
     
-    // Generar todos los posibles rayos que partan de un lado y lleguen al lado opuesto
-    if (sd.method == 0) {
-        unsigned num_rays = 2 * imgsize * imgsize;
-        D = SparseMatrix(num_rays, num_cells);
-        
-        for (unsigned i = 0; i < ts.size(); i++) {
-            ts[i].resize(num_rays);
-        }
-        
-        unsigned ray_index = 0;
-        
-        for (unsigned y0 = 0; y0 < imgsize; y0++) {
-            for (unsigned y1 = 0; y1 < imgsize; y1++) {
-                simulate_ray(sd, ray_index, 0, y0, imgsize - 1, y1, D, ts);
-                ray_index++;
-            }
-        }
-        
-        for (unsigned x0 = 0; x0 < imgsize; x0++) {
-            for (unsigned x1 = 0; x1 < imgsize; x1++) {
-                simulate_ray(sd, ray_index, x0, 0, x1, imgsize - 1, D, ts);
-                ray_index++;
-            }
+    unique_ptr<Geometry> geometry = make_geometry(sd.geometry, sd.image.size(), sd.seed);
+    unsigned num_rays = geometry->num_rays();
+    
+    GeometryKey key = geometry_key(sd);
+    
+    string cache_file;
+    bool cached = false;
+    if (with_matrix and !sd.cache_dir.empty()) {
+        cache_file = geometry_file(sd.cache_dir, key);
+        cached = load_matrix(cache_file, key, D) and D.num_rows() == num_rays and D.num_columns() == num_cells;
+        if (cached) {
+            cout << "Usando la matriz D de " << cache_file << endl;
         }
     }
     
-    // Rayos verticales, horizontales y diagonales
-    else if (sd.method == 1) {
-        unsigned num_rays = 6 * imgsize - 6;
-        D = SparseMatrix(num_rays, num_cells);
-        
-        for (unsigned i = 0; i < ts.size(); i++) {
-            ts[i].resize(num_rays);
-        }
-        
-        unsigned ray_index = 0;
-        
-        for (unsigned y = 0; y < imgsize; y++) {
-            simulate_ray(sd, ray_index, 0, y, imgsize - 1, y, D, ts);
-            ray_index++;
-        }
-        for (unsigned x = 0; x < imgsize; x++) {
-            simulate_ray(sd, ray_index, x, 0, x, imgsize - 1, D, ts);
-            ray_index++;
-        }
-        
-        for (unsigned y = 0; y < imgsize - 1; y++) {
-            simulate_ray(sd, ray_index, 0, y, DOWN_RIGHT, D, ts);
-            ray_index++;
-        }
-        
-        for (unsigned x = 1; x < imgsize - 1; x++) {
-            simulate_ray(sd, ray_index, x, 0, DOWN_RIGHT, D, ts);
-            ray_index++;
-        }
-        
-        for (unsigned y = 1; y < imgsize; y++) {
-            simulate_ray(sd, ray_index, 0, y, UP_RIGHT, D, ts);
-            ray_index++;
-        }
-        
-        for (unsigned x = 1; x < imgsize - 1; x++) {
-            simulate_ray(sd, ray_index, x, imgsize - 1, UP_RIGHT, D, ts);
-            ray_index++;
+    vector<vector<Triplet> > hits(num_threads());
+    Vector times(num_rays);
+    PixelTracer tracer(sd.image, sd.cell_size, sd.discr_size);
+    trace_rays(sd, *geometry, tracer, 0, num_rays, times, (cached or !with_matrix) ? 0 : &hits);
+    
+    if (with_matrix and !cached) {
+        D = SparseMatrix(num_rays, num_cells, hits);
+        if (!cache_file.empty() and !save_matrix(cache_file, key, D)) {
+            cout << "No se pudo guardar la matriz D en " << cache_file << endl;
         }
     }
     
-    // Desde cada una de las cuatro esquinas barrer toda la imagen con rayos
-    else if (sd.method == 2) {
-        unsigned num_rays = 4*(2 * imgsize - 1);
-        D = SparseMatrix(num_rays, num_cells);
-        
-        for (unsigned i = 0; i < ts.size(); i++) {
-            ts[i].resize(num_rays);
-        }
-        
-        unsigned ray_index = 0;
-        
-        for (unsigned y = 0; y < imgsize; y++) {
-            simulate_ray(sd, ray_index, 0, 0, imgsize - 1, y, D, ts);
-            ray_index++;
-        }
-        for (unsigned x = 0; x < imgsize - 1; x++) {
-            simulate_ray(sd, ray_index, 0, 0, x, imgsize - 1, D, ts);
-            ray_index++;
+    add_noise(sd, times, ts);
+}
+
+/* Como simulate, pero sin tener nunca D entera en memoria: los rayos 
+ * se trazan de a bloques y las filas de cada bloque se escriben en 
+ * rows, en otro hilo mientras se traza el bloque siguiente. Un rayo 
+ * atraviesa a lo sumo 2m - 1 celdas (avanza en x y en y siempre en el 
+ * mismo sentido), asi que los bloques tienen la cantidad de rayos 
+ * cuyos elementos en el peor caso ocupan la tercera parte de budget 
+ * bytes: en memoria hay a la vez los elementos del bloque que se esta 
+ * trazando, ese bloque ya en filas y el anterior, que se esta 
+ * escribiendo. budget acota solo lo que ocupa D: los vectores de 
+ * tamaño igual a la cantidad de rayos (times, los de ts y los que 
+ * usan despues CGLS y SART) van aparte. Devuelve falso si no se pudo 
+ * crear o escribir el archivo (en el directorio de $TMPDIR, o en 
+ * /tmp). */
+bool simulate_stream(const SimulationData& sd, RowFile& rows, vector<Vector>& ts, size_t budget)
+{
+    cout << "Simulando tomografia..." << endl;
+    
+    unique_ptr<Geometry> geometry = make_geometry(sd.geometry, sd.image.size(), sd.seed);
+    unsigned num_rays = geometry->num_rays();
+    
+    const char* dir = getenv("TMPDIR");
+    if (!rows.create(dir != 0 and *dir != 0 ? dir : "/tmp", sd.discr_size * sd.discr_size)) {
+        return false;
+    }
+    
+    size_t ray_bytes = 2 * sd.discr_size * sizeof(Triplet);
+    unsigned chunk_rays = (unsigned)max((size_t)1, min((size_t)num_rays, budget / 3 / ray_bytes));
+    
+    vector<vector<Triplet> > hits(num_threads());
+    Vector times(num_rays);
+    PixelTracer tracer(sd.image, sd.cell_size, sd.discr_size);
+    RowChunk chunks[2];
+    bool written = true;
+    thread writer;
+    for (unsigned first = 0, k = 0; first < num_rays; first += chunk_rays, k++) {
+        unsigned last = min(first + chunk_rays, num_rays);
+        for (unsigned t = 0; t < hits.size(); t++) {
+            hits[t].clear();
         }
+        trace_rays(sd, *geometry, tracer, first, last, times, &hits);
         
-        for (unsigned y = 0; y < imgsize; y++) {
-            simulate_ray(sd, ray_index, imgsize - 1, 0, 0, y, D, ts);
-            ray_index++;
+        RowChunk& chunk = chunks[k % 2];
+        chunk.assign(first, last, hits);
+        if (writer.joinable()) {
+            writer.join();
         }
-        for (unsigned x = 1; x < imgsize; x++) {
-            simulate_ray(sd, ray_index, imgsize - 1, 0, x, imgsize - 1, D, ts);
-            ray_index++;
+        writer = thread([&rows, &chunk, &written]() {
+            written = rows.append(chunk) and written;
+        });
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+    cout << "Matriz D en disco: " << rows.num_chunks() << " bloques de hasta " << chunk_rays << " rayos" << endl;
+    
+    add_noise(sd, times, ts);
+    return written;
+}
+
+/* Retroproyeccion filtrada a partir de los tiempos de los rayos. Con 
+ * el trazado exacto el tiempo 
+ * ya es la integral de la imagen sobre el rayo; con el de pixeles es 
+ * la suma de los pixeles visitados, que son unos |dx| + |dy| por cada 
+ * longitud L recorrida, asi que se lo escala por L / (|dx| + |dy|). */
+vector<Vector> filtered_back_projection(const SimulationData& sd, const vector<Vector>& ts, FbpFilter filter, Metrics& metrics)
+{
+    unique_ptr<Geometry> geometry = make_geometry(sd.geometry, sd.image.size(), sd.seed);
+    vector<Line> lines;
+    geometry->lines(0, geometry->num_rays(), lines);
+    Vector weights(lines.size(), 1.0);
+    for (unsigned r = 0; r < lines.size(); r++) {
+        const Line& line = lines[r];
+        if (sd.tracer == PIXEL_TRACER) {
+            double dx = fabs(line.x1 - line.x0);
+            double dy = fabs(line.y1 - line.y0);
+            if (dx + dy > 0.0) {
+                weights[r] = sqrt(dx*dx + dy*dy) / (dx + dy);
+            }
         }
-        
-        for (unsigned y = 0; y < imgsize; y++) {
-            simulate_ray(sd, ray_index, 0, imgsize - 1, imgsize - 1, y, D, ts);
-            ray_index++;
+    }
+    
+    vector<Vector> ps = ts;
+    for (unsigned k = 0; k < ps.size(); k++) {
+        for (unsigned r = 0; r < ps[k].size(); r++) {
+            ps[k][r] *= weights[r];
         }
-        for (unsigned x = 0; x < imgsize - 1; x++) {
-            simulate_ray(sd, ray_index, 0, imgsize - 1, x, 0, D, ts);
-            ray_index++;
+    }
+    return fbp(sd.image.size(), sd.cell_size, lines, ps, filter, metrics);
+}
+
+/* Como least_squares, pero usando la descomposicion de D guardada en 
+ * el directorio de cache si ya esta (con lo que solo quedan los 
+ * productos por U^t y V), o guardandola ahi si no. */
+vector<Vector> cached_least_squares(const SimulationData& sd, const SparseMatrix& D, const vector<Vector>& ts, const EigenParams& params, const Regularization& reg, Metrics& metrics)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    GeometryKey key = geometry_key(sd);
+    string file = factorization_file(sd.cache_dir, key, params);
+    
+    Factorization F;
+    if (load_factorization(file, key, params, F) and F.Ut.num_columns() == D.num_rows() and F.V.num_rows() == D.num_columns()) {
+        cout << "Usando la descomposicion de " << file << endl;
+    }
+    else {
+        factorize(D, params, F);
+        if (!F.svalues.empty() and !save_factorization(file, key, params, F)) {
+            cout << "No se pudo guardar la descomposicion en " << file << endl;
         }
-        
-        for (unsigned y = 0; y < imgsize; y++) {
-            simulate_ray(sd, ray_index, imgsize - 1, imgsize - 1, 0, y, D, ts);
-            ray_index++;
+    }
+    
+    vector<Vector> s = solve(F, ts, reg, metrics);
+    
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    return s;
+}
+
+vector<Vector> iterative_solve(const SparseMatrix& D, const vector<Vector>& ts, const Options& opts, Metrics& metrics, const vector<Vector>& x0s = vector<Vector>())
+{
+    if (opts.solver == CGLS) {
+        return cgls(D, ts, opts.iterative, metrics, x0s);
+    }
+    else if (opts.solver == ART) {
+        return art(D, ts, opts.iterative, metrics, x0s);
+    }
+    else {
+        return sart(D, ts, opts.iterative, metrics, x0s);
+    }
+}
+
+/* Lleva la solucion x, de coarse_size x coarse_size celdas de 
+ * coarse_cell pixeles, a una grilla de fine_size x fine_size celdas de 
+ * fine_cell pixeles, interpolando bilinealmente entre los centros de 
+ * las celdas gruesas. Mas alla del primer y el ultimo centro se repite 
+ * el valor del borde. */
+Vector prolongate(const Vector& x, unsigned coarse_size, unsigned coarse_cell, unsigned fine_size, unsigned fine_cell)
+{
+    vector<unsigned> low(fine_size), high(fine_size);
+    vector<double> weight(fine_size);
+    for (unsigned i = 0; i < fine_size; i++) {
+        double u = (i + 0.5) * fine_cell / coarse_cell - 0.5;
+        u = min(max(u, 0.0), (double)(coarse_size - 1));
+        low[i] = (unsigned)u;
+        high[i] = min(low[i] + 1, coarse_size - 1);
+        weight[i] = u - low[i];
+    }
+    
+    Vector res(fine_size * fine_size);
+    for (unsigned i = 0; i < fine_size; i++) {
+        for (unsigned j = 0; j < fine_size; j++) {
+            double top = (1.0 - weight[j]) * x[low[i]*coarse_size + low[j]] + weight[j] * x[low[i]*coarse_size + high[j]];
+            double bottom = (1.0 - weight[j]) * x[high[i]*coarse_size + low[j]] + weight[j] * x[high[i]*coarse_size + high[j]];
+            res[i*fine_size + j] = (1.0 - weight[i]) * top + weight[i] * bottom;
         }
-        for (unsigned x = 1; x < imgsize; x++) {
-            simulate_ray(sd, ray_index, imgsize - 1, imgsize - 1, x, 0, D, ts);
-            ray_index++;
+    }
+    return res;
+}
+
+/* Resuelve con el metodo iterativo elegido empezando por una 
+ * discretizacion gruesa (celdas de cell_size * 2^(levels-1) pixeles) 
+ * y usando la solucion de cada nivel, interpolada, como x inicial del 
+ * siguiente, hasta llegar a la de sd. Los rayos no dependen del tamaño 
+ * de celda, asi que los tiempos ts (con su ruido) sirven para todos los 
+ * niveles y solo hay que armar la D de cada uno (los rayos aleatorios 
+ * dependen solo de la semilla, asi que son los mismos). Se saltean los 
+ * niveles cuya celda no es mas chica que la imagen. El tiempo de 
+ * reconstruccion es la suma del de todos los niveles (sin contar el 
+ * armado de las D). */
+vector<Vector> multiresolution(const SimulationData& sd, const SparseMatrix& D, const vector<Vector>& ts, const Options& opts, Metrics& metrics, vector<unsigned>& level_cells, vector<unsigned>& level_iterations)
+{
+    level_cells.clear();
+    for (unsigned l = opts.levels - 1; l > 0; l--) {
+        if ((sd.cell_size << l) < sd.image.size()) {
+            level_cells.push_back(sd.cell_size << l);
         }
     }
+    level_cells.push_back(sd.cell_size);
     
-    // Rayos aleatorios, sd.method indica la cantidad de rayos a generar
-    else {
-      
-        unsigned num_rays = sd.method;
-        D = SparseMatrix(num_rays, num_cells);
-        
-        for (unsigned i = 0; i < ts.size(); i++) {
-            ts[i].resize(num_rays);
+    double total_time = 0.0;
+    vector<Vector> s;
+    level_iterations.clear();
+    for (unsigned l = 0; l < level_cells.size(); l++) {
+        SparseMatrix coarse_D;
+        const SparseMatrix* A = &D;
+        if (level_cells[l] != sd.cell_size) {
+            SimulationData level = sd;
+            level.cell_size = level_cells[l];
+            level.discr_size = discretization_size(sd.image.size(), level.cell_size);
+            vector<Vector> no_times;
+            simulate(level, coarse_D, no_times);
+            A = &coarse_D;
         }
         
-        for (unsigned i = 0; i < num_rays; i++) {
-            unsigned r0 = rand() % 6;
-            unsigned r1 = rand() % imgsize;
-            unsigned r2 = rand() % imgsize;
-            if (r0 == 0) {
-                simulate_ray(sd, i, 0, r1, imgsize - 1, r2, D, ts);
-            }
-            else if (r0 == 1) {
-                simulate_ray(sd, i, r1, 0, r2, imgsize - 1, D, ts);
-            }
-            else if (r0 == 2) {
-                simulate_ray(sd, i, 0, r1, r2, 0, D, ts);
-            }
-            else if (r0 == 3) {
-                simulate_ray(sd, i, r1, 0, imgsize - 1, r2, D, ts);
-            }
-            else if (r0 == 4) {
-                simulate_ray(sd, i, imgsize - 1, r1, r2, imgsize - 1, D, ts);
-            }
-            else {
-                simulate_ray(sd, i, r1, imgsize - 1, 0, r2, D, ts);
+        if (l > 0) {
+            unsigned coarse_size = discretization_size(sd.image.size(), level_cells[l-1]);
+            unsigned fine_size = discretization_size(sd.image.size(), level_cells[l]);
+            for (unsigned k = 0; k < s.size(); k++) {
+                s[k] = prolongate(s[k], coarse_size, level_cells[l-1], fine_size, level_cells[l]);
             }
         }
+        
+        s = iterative_solve(*A, ts, opts, metrics, s);
+        total_time += metrics.reconstruction_time;
+        level_iterations.push_back(metrics.num_iterations);
     }
+    
+    metrics.reconstruction_time = total_time;
+    return s;
 }
 
 void output_results(const SimulationData& sd, const Metrics& metrics)
 {
     ofstream ofile("results.txt", std::ios::app);
-    ofile << sd.image.size() << " " << sd.cell_size << " " << sd.discr_size << " " << sd.method << endl;
+    ofile << sd.image.size() << " " << sd.cell_size << " " << sd.discr_size << " " << method_name(sd.geometry) << endl;
     ofile << metrics.cond_number << endl;
     ofile << metrics.reconstruction_time << endl;
     ofile << metrics.num_eigen_found << endl;
@@ -421,56 +824,136 @@ void output_results(const SimulationData& sd, const Metrics& metrics)
 
 int main(int argc, char* argv[])
 {
-    if (argc < 6) {
+    SimulationData sd;
+    Metrics metrics;
+    Options opts;
+    
+    // Separamos las opciones (--nombre=valor) de los parametros posicionales
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") == 0) {
+            if (!parse_option(arg, opts)) {
+                cout << "Error: opcion invalida " << arg << "." << endl;
+                return 1;
+            }
+        }
+        else {
+            args.push_back(arg);
+        }
+    }
+    
+    if (args.size() < 5) {
         cout << "Error: parametros invalidos." << endl;
         return 1;
     }
     
-    srand(1000);
-    
-    SimulationData sd;
-    Metrics metrics;
+    srand(opts.seed);
     
     // Leemos parametros
-    string img_name_in = argv[1];
-    string img_name_out = argv[2];
-    sd.cell_size = stoi(argv[3]);
-    sd.method = stoi(argv[4]);
+    string img_name_in = args[0];
+    string img_name_out = args[1];
+    sd.cell_size = stoi(args[2]);
+    sd.geometry = opts.geometry;
+    if (!parse_method(args[3], sd.geometry)) {
+        cout << "Error: metodo invalido " << args[3] << "." << endl;
+        return 1;
+    }
+    sd.tracer = opts.tracer;
+    sd.seed = opts.seed;
+    sd.cache_dir = opts.cache_dir;
 
     // Leemos los niveles de ruido y armamos los nombres de salida
     vector<string> out_names;
-    int i = 5;
-    while (i < argc) {
-        sd.noise_levels.push_back(atof(argv[i]));
+    for (unsigned i = 4; i < args.size(); i++) {
+        sd.noise_levels.push_back(atof(args[i].c_str()));
         out_names.push_back(img_name_out);
         size_t pos = out_names.back().rfind('.');
         if (pos != string::npos) {
-            out_names.back().insert(pos, string("_") + argv[i]);
+            out_names.back().insert(pos, string("_") + args[i]);
         }
         else {
-            out_names.back().append(string("_") + argv[i]);
+            out_names.back().append(string("_") + args[i]);
         }
-        i++;
     }
     
     metrics.psnr.resize(sd.noise_levels.size());
 
     // Cargamos la imagen de entrada
-    if (!load_csv_image(img_name_in, sd.image)) {
+    if (!load_image(img_name_in, sd.image)) {
         cout << "Error: no se pudo abrir " << img_name_in << "." << endl;
         return 1;
     }
+    if (sd.image.width() != sd.image.height()) {
+        cout << "Error: la imagen " << img_name_in << " no es cuadrada." << endl;
+        return 1;
+    }
     
     // Obtenemos tamaño de la discretizacion
-    sd.discr_size = sd.image.size() / sd.cell_size;
-    if (sd.image.size() % sd.cell_size != 0) {
-        sd.discr_size++;
-    }
+    sd.discr_size = discretization_size(sd.image.size(), sd.cell_size);
 
     // Simulamos la tomografia, obteniendo la matriz D y los vectores t (y el tiempo de ejecucion)
+    if (opts.regularization.automatic and opts.solver != SVD) {
+        cout << "Error: --lambda=gcv requiere --solver=svd." << endl;
+        return 1;
+    }
+    
+    bool scanner = sd.geometry.type == PARALLEL_BEAM or sd.geometry.type == FAN_BEAM;
+    if (opts.solver == FBP and sd.geometry.type != FULL_GEOMETRY and !scanner) {
+        cout << "Error: --solver=fbp requiere el metodo 0, parallel o fan." << endl;
+        return 1;
+    }
+    
+    if ((sd.geometry.angles != 0 or sd.geometry.detectors != 0) and !scanner) {
+        cout << "Error: --angles y --detectors requieren el metodo parallel o fan." << endl;
+        return 1;
+    }
+    
+    if (sd.geometry.source_distance != 0.0 and sd.geometry.type != FAN_BEAM) {
+        cout << "Error: --source-distance requiere el metodo fan." << endl;
+        return 1;
+    }
+    
+    // Los valores por defecto de los tomografos dependen de la discretizacion 
+    // pedida, y se fijan aca para que todos los niveles usen los mismos rayos
+    complete_geometry(sd.geometry, sd.image.size(), sd.discr_size);
+    if (sd.geometry.type == FAN_BEAM and sd.geometry.source_distance <= sd.image.size() / sqrt(2.0)) {
+        cout << "Error: con --source-distance la fuente tiene que quedar fuera de la imagen (a mas de " 
+             << sd.image.size() / sqrt(2.0) << " pixeles del centro)." << endl;
+        return 1;
+    }
+    
+    if (opts.levels > 1 and opts.solver != CGLS and opts.solver != ART and opts.solver != SART) {
+        cout << "Error: --levels requiere --solver=cgls, art o sart." << endl;
+        return 1;
+    }
+    
+    if (opts.iterative.precision != DOUBLE_PRECISION and opts.solver != CGLS and opts.solver != ART and opts.solver != SART) {
+        cout << "Error: --precision requiere --solver=cgls, art o sart." << endl;
+        return 1;
+    }
+    
+    if (opts.stream_budget != 0 and opts.solver != CGLS and opts.solver != SART) {
+        cout << "Error: --stream requiere --solver=cgls o sart." << endl;
+        return 1;
+    }
+    
+    if (opts.stream_budget != 0 and (opts.iterative.precision != DOUBLE_PRECISION or opts.levels > 1 or !sd.cache_dir.empty())) {
+        cout << "Error: --stream no se puede usar con --precision, --levels ni --cache." << endl;
+        return 1;
+    }
     SparseMatrix D;
+    RowFile rows;
     vector<Vector> ts(sd.noise_levels.size());
-    simulate(sd, D, ts);
+    if (opts.stream_budget != 0) {
+        if (!simulate_stream(sd, rows, ts, opts.stream_budget)) {
+            cout << "Error: no se pudo escribir la matriz D en disco." << endl;
+            return 1;
+        }
+    }
+    else {
+        simulate(sd, D, ts, opts.solver != FBP);
+    }
     
     // En este punto se puede imprimir la matriz D en un archivo, con 
     // la funcion print de debug.h, para luego ver los autovalores de DtD 
@@ -478,15 +961,67 @@ int main(int argc, char* argv[])
     
     // Reconstruimos la imagen
     cout << "Reconstruyendo imagen..." << endl;
-    vector<Vector> s = least_squares(D, ts, metrics);
-    vector<Image> results = convert_to_images(s, sd.discr_size);
-    for (unsigned i = 0; i < results.size(); i++) {
-        save_as_csv_image(out_names[i], results[i]);
-        metrics.psnr[i] = get_psnr(scale(results[i], sd.image.size(), sd.cell_size), sd.image);
+    vector<Vector> s;
+    vector<unsigned> level_cells, level_iterations;
+    if (opts.stream_budget != 0) {
+        s = opts.solver == CGLS ? cgls(rows, ts, opts.iterative, metrics) : sart(rows, ts, opts.iterative, metrics);
+        if (rows.failed()) {
+            cout << "Error: no se pudo leer la matriz D del disco." << endl;
+            return 1;
+        }
+    }
+    else if (opts.levels > 1) {
+        s = multiresolution(sd, D, ts, opts, metrics, level_cells, level_iterations);
+    }
+    else if (opts.solver == CGLS or opts.solver == ART or opts.solver == SART) {
+        s = iterative_solve(D, ts, opts, metrics);
+    }
+    else if (opts.solver == FBP) {
+        s = filtered_back_projection(sd, ts, opts.filter, metrics);
+    }
+    else if (sd.cache_dir.empty()) {
+        s = least_squares(D, ts, opts.eigen, opts.regularization, metrics);
+    }
+    else {
+        s = cached_least_squares(sd, D, ts, opts.eigen, opts.regularization, metrics);
+    }
+    
+    // Guardamos las imagenes y calculamos el PSNR, un nivel de ruido por hilo
+    vector<char> saved(s.size());
+    parallel_for(s.size(), [&](unsigned, unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+            saved[i] = save_image(out_names[i], convert_to_image(s[i], sd.discr_size));
+            metrics.psnr[i] = get_psnr(s[i], sd);
+        }
+    });
+    for (unsigned i = 0; i < saved.size(); i++) {
+        if (!saved[i]) {
+            cout << "No se pudo guardar " << out_names[i] << endl;
+        }
     }
     
     cout << "Tiempo de reconstruccion: " << metrics.reconstruction_time << " segundos." << endl;
-    cout << "Numero de condicion de la matriz DtD: " << metrics.cond_number << endl;
+    if (opts.solver == CGLS) {
+        cout << "Iteraciones de CGLS: " << metrics.num_iterations << endl;
+    }
+    else if (opts.solver == ART or opts.solver == SART) {
+        cout << "Pasadas por las filas: " << metrics.num_iterations << endl;
+    }
+    for (unsigned l = 0; l < level_cells.size(); l++) {
+        cout << "  con celdas de " << level_cells[l] << " pixeles: " << level_iterations[l] << endl;
+    }
+    if (opts.solver == SVD and metrics.num_eigen_found == 0) {
+        cout << "D no tiene valores singulares distintos de cero: la solucion es cero." << endl;
+    }
+    else if (opts.solver == SVD) {
+        cout << "Numero de condicion de la matriz DtD: " << metrics.cond_number << endl;
+    }
+    
+    if (opts.solver == SVD and (opts.regularization.automatic or opts.regularization.lambda != 0.0)) {
+        for (unsigned i = 0; i < metrics.lambdas.size(); i++) {
+            cout << "Lambda para nivel de ruido " << sd.noise_levels[i] << ": " << metrics.lambdas[i] << endl;
+        }
+    }
     
     for (unsigned i = 0; i < metrics.psnr.size(); i++) {
         cout << "PSNR correspondiente a nivel de ruido " << sd.noise_levels[i] << ": " << metrics.psnr[i] << endl;
@@ -1,130 +1,118 @@
 #include "matrix.h"
+#include "parallel.h"
+#include "kernels.h"
+#include "linear_operator.h"
+#include <algorithm>
 #include <cmath>
 #include <ctime>
 #include <iostream>
-#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 
-// Parametros asociados al criterio de convergencia del metodo de la potencia
-#define PM_MAX_ERROR_1 0.01
-#define PM_MAX_ERROR_2 0.1
+// Cantidad de elementos de B que se intentan mantener en cache en el producto de matrices
+#define GEMM_BLOCK_ELEMENTS 16384
+
+// Cantidad minima de elementos de la matriz para repartir el producto matriz-vector entre hilos
+#define GEMV_PARALLEL_ELEMENTS 262144
 
 using namespace std;
 
-static const double epsilon = numeric_limits<double>::epsilon();
+static double* allocate(size_t elements) {
+    if (elements == 0) {
+        return 0;
+    }
+    void* p = 0;
+    if (posix_memalign(&p, MATRIX_ALIGNMENT, elements * sizeof(double)) != 0) {
+        throw bad_alloc();
+    }
+    return static_cast<double*>(p);
+}
 
-void Matrix::set_row(unsigned i, const Vector& row) {
-    for (unsigned j = 0; j < num_columns(); j++) {
-        _mat[i][j] = row[j];
+Matrix::Matrix(unsigned rows, unsigned columns)
+: _rows(rows), _columns(columns), _ld(aligned_columns(columns)) {
+    _data = allocate(_rows * _ld);
+    if (_data != 0) {
+        memset(_data, 0, _rows * _ld * sizeof(double));
     }
 }
 
-void Matrix::set_column(unsigned j, const Vector& column) {
-    for (unsigned i = 0; i < num_rows(); i++) {
-        _mat[i][j] = column[i];
+Matrix::Matrix(unsigned rows, unsigned columns, double* data, shared_ptr<const void> storage)
+: _data(data), _rows(rows), _columns(columns), _ld(aligned_columns(columns)), _storage(storage) {}
+
+Matrix::Matrix(const Matrix& other)
+: _rows(other._rows), _columns(other._columns), _ld(other._ld) {
+    _data = allocate(_rows * _ld);
+    if (_data != 0) {
+        memcpy(_data, other._data, _rows * _ld * sizeof(double));
     }
 }
 
-void Matrix::operator/=(double d) {
-    for (unsigned i = 0; i < num_rows(); i++) {
-        for (unsigned j = 0; j < num_columns(); j++) {
-            _mat[i][j] /= d;
-        }
+Matrix::Matrix(Matrix&& other)
+: _data(other._data), _rows(other._rows), _columns(other._columns), _ld(other._ld), _storage(move(other._storage)) {
+    other._data = 0;
+    other._rows = other._columns = 0;
+    other._ld = 0;
+}
+
+Matrix::~Matrix() {
+    if (!_storage) {
+        free(_data);
     }
 }
 
-/* Calcula autovalores y autovectores, termina cuando se hayan 
- * hallado todos, cuando el calculo de uno de ellos falle, cuando 
- * un autovalor resulte menor a epsilon o negativo, o cuando un 
- * autovalor sea mucho mas grande al ultimo calculado. */
-void Matrix::find_eigen(vector<double>& evalues, vector<Vector>& evectors) const {
-    unsigned n = _mat.size();
-    Matrix aux = *this;
-    double eigenval;
-    Vector eigenvec(n);
-    for (unsigned k = 0; k < n; k++) {
-        randomize(eigenvec);
-        bool failed = !aux.find_main_eigen(eigenval, eigenvec, *this);
-        if ( failed or eigenval < epsilon or (evalues.size() != 0 and evalues.back()/eigenval < 0.1 ) ) {
-            return;
-        }
+Matrix& Matrix::operator=(Matrix other) {
+    swap(_data, other._data);
+    swap(_rows, other._rows);
+    swap(_columns, other._columns);
+    swap(_ld, other._ld);
+    swap(_storage, other._storage);
+    return *this;
+}
 
-        evalues.push_back(eigenval);
-        evectors.push_back(eigenvec);
-        
-        // Deflacion
-        for (unsigned i = 0; i < n; i++) {
-            for (unsigned j = 0; j < n; j++) {
-                aux(i,j) = aux(i,j) - eigenval*eigenvec[i]*eigenvec[j];
-            }
-        }
+void Matrix::set_row(unsigned i, const Vector& row) {
+    double* r = &(*this)(i,0);
+    for (unsigned j = 0; j < _columns; j++) {
+        r[j] = row[j];
+    }
+}
 
+void Matrix::set_column(unsigned j, const Vector& column) {
+    for (unsigned i = 0; i < _rows; i++) {
+        (*this)(i,j) = column[i];
     }
 }
 
-/* La funcion toma como parametro adicional la verdadera matriz a la 
- * cual le estamos calculando el autovalor y autovector. La idea es que 
- * queremos parar de iterar una vez que el autovector actual 'v' y el 
- * autovalor actual 'k' cumplan que ||Av - kv|| sea muy chica comparada 
- * con ||kv||, siendo A la matriz original (que no es *this) y k = v^t Av
- * Esto va a evitar que al aplicar deflacion se vayan acumulando errores,
- * y por lo tanto los primeros autovalores/vectores van a ser tan precisos 
- * como los ultimos. Es mas, gracias a esto podemos ser menos estrictos 
- * con el máximo error tolerado (PM_MAX_ERROR_1), lo cual viene bien para 
- * el tiempo de ejecucion.
- *
- * Un inconveniente es que con esto (segun observaciones) puede pasar que 
- * no se logre un error menor a PM_MAX_ERROR_1 nunca, generando que la funcion 
- * se quede iterando infinitamente. Esto se soluciona viendo si el error 
- * es igual (con epsilon de C++) al ultimo obtenido, y en ese caso se 
- * devuelve lo que se tenga hasta ese momento. Al parecer cuando sucede 
- * esto no es muy grave y en general no vuelve a suceder con las proximas 
- * llamadas a esta funcion.
- *
- * Sin embargo, si detectamos que el error no cambio pero ademas es demasiado 
- * grande, es decir, mayor a PM_MAX_ERROR_2, entonces se concluye que el 
- * calculo del autovector/valor fallo y por lo tanto la funcion devuelve falso.
- 
- * El calculo del error se hace luego de una cantidad fija de iteraciones, 
- * en vez de hacerlo en todas, para acelerar un poco el proceso. */
-bool Matrix::find_main_eigen(double& eigenval, Vector& eigenvec, const Matrix& original) const {
-    unsigned n = _mat.size();
-    eigenvec /= two_norm(eigenvec);
-    Vector temp;
-    unsigned k = 0;
-    double old_squared_error = 999999.0;
-    while (true) {
-        for (unsigned i = 0; i < 25; i++) {
-            eigenvec = (*this)*eigenvec;
-            eigenvec /= two_norm(eigenvec);
-            k++;
-        }
-        
-        temp = original*eigenvec;
-        eigenval = inner_product(eigenvec, temp);
-        
-        double squared_error = 0.0;
-        for (unsigned i = 0; i < n; i++) {
-            squared_error += (temp[i] - eigenval * eigenvec[i])*(temp[i] - eigenval * eigenvec[i]);
-        }
-        squared_error /= eigenval*eigenval;
-        
-        if (squared_error <= PM_MAX_ERROR_1*PM_MAX_ERROR_1) {
-            break;
+void Matrix::operator/=(double d) {
+    for (unsigned i = 0; i < _rows; i++) {
+        double* r = &(*this)(i,0);
+        for (unsigned j = 0; j < _columns; j++) {
+            r[j] /= d;
         }
-        else if (fabs(squared_error - old_squared_error) < epsilon) {
-            if (squared_error <= PM_MAX_ERROR_2*PM_MAX_ERROR_2) {
-                break;
-            }
-            else {
-                return false;
+    }
+}
+
+void Matrix::find_eigen(vector<double>& evalues, vector<Vector>& evectors, const EigenParams& params) const {
+    power_method(DenseOperator(*this), params, evalues, evectors);
+}
+
+/* Se transpone por bloques cuadrados para que tanto las lecturas 
+ * como las escrituras queden dentro de pocas lineas de cache. */
+Matrix transpose(const Matrix& A) {
+    const unsigned block = 32;
+    Matrix res(A.num_columns(), A.num_rows());
+    for (unsigned i0 = 0; i0 < A.num_rows(); i0 += block) {
+        unsigned i1 = min(A.num_rows(), i0 + block);
+        for (unsigned j0 = 0; j0 < A.num_columns(); j0 += block) {
+            unsigned j1 = min(A.num_columns(), j0 + block);
+            for (unsigned i = i0; i < i1; i++) {
+                for (unsigned j = j0; j < j1; j++) {
+                    res(j,i) = A(i,j);
+                }
             }
         }
-        else {
-            old_squared_error = squared_error;
-        }
     }
-    
-    return true;
+    return res;
 }
 
 Matrix operator-(const Matrix& A, const Matrix& B) {
@@ -147,14 +135,49 @@ Matrix operator*(double k, const Matrix& A) {
     return res;
 }
 
+/* El producto usa el nucleo gemv mas rapido que soporte el procesador. 
+ * Si la matriz es grande, las filas se reparten entre los hilos; cada 
+ * elemento del resultado lo calcula siempre un unico hilo, asi que el 
+ * resultado no depende de la cantidad de hilos. */
 Vector operator*(const Matrix& A, const Vector& x) {
     Vector res(A.num_rows(), 0.0);
-    for (unsigned i = 0; i < res.size(); i++) {
-        double temp = 0.0;
-        for (unsigned k = 0; k < A.num_columns(); k++) {
-            temp += A(i,k) * x[k];
-        }
-        res[i] = temp;
+    unsigned n = A.num_rows();
+    if (n == 0) {
+        return res;
+    }
+    if ((size_t)n * A.num_columns() < GEMV_PARALLEL_ELEMENTS) {
+        gemv(A.data(), A.leading_dimension(), n, A.num_columns(), &x[0], &res[0]);
+        return res;
+    }
+    parallel_for(n, [&](unsigned, unsigned begin, unsigned end) {
+        gemv(&A(begin,0), A.leading_dimension(), end - begin, A.num_columns(), &x[0], &res[begin]);
+    });
+    return res;
+}
+
+/* Producto de matrices por bloques. Las filas de B se procesan de a 
+ * bloques que entran en cache, asi que A se lee de memoria una sola 
+ * vez y cada bloque de B se reusa para todas las filas de A. Dentro de 
+ * cada bloque el nucleo gemm mantiene en registros un pedazo de C 
+ * mientras recorre la dimension interna. Las filas de C se reparten 
+ * entre los hilos; cada elemento se acumula siempre en el mismo orden. */
+Matrix operator*(const Matrix& A, const Matrix& B) {
+    unsigned n = A.num_rows();
+    unsigned inner = A.num_columns();
+    unsigned r = B.num_columns();
+    Matrix res(n, r);
+    if (n == 0 or r == 0) {
+        return res;
     }
+    unsigned block = max(16u, GEMM_BLOCK_ELEMENTS / r);
+    
+    parallel_for(n, [&](unsigned, unsigned begin, unsigned end) {
+        for (unsigned p0 = 0; p0 < inner; p0 += block) {
+            unsigned p1 = min(inner, p0 + block);
+            gemm_block(&A(begin,p0), A.leading_dimension(), &B(p0,0), B.leading_dimension(), 
+                       &res(begin,0), res.leading_dimension(), end - begin, p1 - p0, r);
+        }
+    });
+    
     return res;
-}
\ No newline at end of file
+}
@@ -2,6 +2,12 @@
 #define MATRIX_H
 
 #include "vector.h"
+#include "eigen.h"
+#include <cstddef>
+#include <memory>
+
+// Alineacion (en bytes) del bloque donde se guardan los elementos
+#define MATRIX_ALIGNMENT 64
 
 class Matrix
 {
@@ -9,32 +15,73 @@ class Matrix
 friend Matrix operator-(const Matrix& A, const Matrix& B);
 friend Matrix operator*(double k, const Matrix& A);
 friend Vector operator*(const Matrix& A, const Vector& x);
+friend Matrix operator*(const Matrix& A, const Matrix& B);
+friend Matrix transpose(const Matrix& A);
 
 public:
 
     /** Crea una matriz vacia. */
-    Matrix() {}
+    Matrix() : _data(0), _rows(0), _columns(0), _ld(0) {}
+
+    /** Crea una matriz con todos sus valores en cero. Las filas se 
+     *  guardan una detras de otra en un unico bloque alineado a 64 
+     *  bytes, y cada una se completa hasta un multiplo de 8 elementos 
+     *  para que todas queden alineadas. */
+    Matrix(unsigned rows, unsigned columns);
+
+    /** Arma la matriz sobre elementos que ya estan en memoria con la 
+     *  misma disposicion (filas de aligned_columns(columns) elementos, 
+     *  alineadas a MATRIX_ALIGNMENT bytes), sin copiarlos. storage 
+     *  mantiene viva esa memoria (por ejemplo, un archivo mapeado) 
+     *  mientras exista la matriz o alguna otra que la comparta. La 
+     *  memoria tiene que admitir escrituras, porque la matriz se puede 
+     *  modificar como cualquier otra. */
+    Matrix(unsigned rows, unsigned columns, double* data, std::shared_ptr<const void> storage);
+
+    Matrix(const Matrix& other);
 
-    /** Crea una matriz sin inicializar sus valores. */
-    Matrix(unsigned rows, unsigned columns)
-    : _mat(rows, std::vector<double>(columns)) {}
+    Matrix(Matrix&& other);
+
+    ~Matrix();
+
+    Matrix& operator=(Matrix other);
     
     unsigned num_rows() const {
-        return _mat.size();
+        return _rows;
     }
     
     unsigned num_columns() const {
-        return _mat[0].size();
+        return _columns;
+    }
+
+    /** Distancia (en elementos) entre el comienzo de dos filas consecutivas. */
+    size_t leading_dimension() const {
+        return _ld;
+    }
+
+    /** Elementos que ocupa cada fila de una matriz de columns columnas 
+     *  (columns redondeado a un multiplo de MATRIX_ALIGNMENT bytes). */
+    static size_t aligned_columns(unsigned columns) {
+        const size_t per_line = MATRIX_ALIGNMENT / sizeof(double);
+        return (columns + per_line - 1) / per_line * per_line;
+    }
+
+    double* data() {
+        return _data;
+    }
+
+    const double* data() const {
+        return _data;
     }
     
     /** Obtiene el elemento (i,j) de la matriz. */
     double& operator()(unsigned i, unsigned j) {
-        return _mat[i][j];
+        return _data[i*_ld + j];
     }
 
     /** Version const. */
     const double& operator()(unsigned i, unsigned j) const {
-        return _mat[i][j];
+        return _data[i*_ld + j];
     }
     
     void set_row(unsigned i, const Vector& row);
@@ -43,19 +90,17 @@ public:
     
     void operator/=(double d);
     
-    /** Devuelve los autovalores y autovectores de la matriz. */
-    void find_eigen(std::vector<double>& evalues, std::vector<Vector>& evectors) const;
+    /** Devuelve los autovalores y autovectores de la matriz, usando 
+     *  el metodo de la potencia con deflacion (ver power_method). */
+    void find_eigen(std::vector<double>& evalues, std::vector<Vector>& evectors, const EigenParams& params = EigenParams()) const;
     
 private:
 
-    /** Devuelve el autovalor de mayor magnitud y 
-     *  su autovector asociado aplicando el metodo 
-     *  de la potencia. */
-    bool find_main_eigen(double& eigenval, Vector& eigenvec, const Matrix& original) const;
-    
-    bool find_main_eigen2(double& eigenval, Vector& eigenvec) const;
-
-    std::vector<std::vector<double> > _mat;
+    double* _data;
+    unsigned _rows;
+    unsigned _columns;
+    size_t _ld;
+    std::shared_ptr<const void> _storage;
 
 };
 
@@ -9,6 +9,8 @@ struct Metrics
     double cond_number;
     std::vector<double> psnr;
     unsigned num_eigen_found;
+    unsigned num_iterations;
+    std::vector<double> lambdas;
 };
 
 #endif
\ No newline at end of file
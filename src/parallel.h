@@ -0,0 +1,89 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Cantidad de hilos a usar (0 indica que se usan todos los nucleos). */
+inline unsigned& thread_setting()
+{
+    static unsigned setting = 0;
+    return setting;
+}
+
+inline void set_num_threads(unsigned n)
+{
+    thread_setting() = n;
+}
+
+inline unsigned num_threads()
+{
+    unsigned n = thread_setting();
+    if (n == 0) {
+        n = std::thread::hardware_concurrency();
+    }
+    return n == 0 ? 1 : n;
+}
+
+/** Divide el rango [0, n) en bloques contiguos, uno por hilo, y 
+ *  llama a f(t, begin, end) para cada hilo t. El bloque de cada hilo 
+ *  depende solo de n y de la cantidad de hilos, asi que el reparto 
+ *  es siempre el mismo. El hilo llamador procesa el primer bloque. */
+template <class F>
+void parallel_for(unsigned n, F f, unsigned threads = num_threads())
+{
+    if (threads > n) {
+        threads = n == 0 ? 1 : n;
+    }
+    
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; t++) {
+        unsigned begin = (unsigned)((unsigned long long)n * t / threads);
+        unsigned end = (unsigned)((unsigned long long)n * (t + 1) / threads);
+        workers.push_back(std::thread(f, t, begin, end));
+    }
+    
+    f(0u, 0u, (unsigned)((unsigned long long)n / threads));
+    
+    for (unsigned t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+}
+
+/** Barrera para los hilos de un mismo parallel_for: wait() bloquea 
+ *  hasta que llegan los count hilos, y se puede volver a usar enseguida. 
+ *  Sirve para separar fases dentro de un unico parallel_for, en vez de 
+ *  lanzar hilos nuevos para cada una. */
+class Barrier
+{
+
+public:
+
+    explicit Barrier(unsigned count) : _count(count), _waiting(0), _generation(0) {}
+    
+    void wait() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        unsigned generation = _generation;
+        if (++_waiting == _count) {
+            _waiting = 0;
+            _generation++;
+            _released.notify_all();
+        }
+        else {
+            _released.wait(lock, [&]() { return _generation != generation; });
+        }
+    }
+    
+private:
+
+    std::mutex _mutex;
+    std::condition_variable _released;
+    unsigned _count;
+    unsigned _waiting;
+    unsigned _generation;
+
+};
+
+#endif
@@ -0,0 +1,434 @@
+#include "pixel_tracer.h"
+#include "image_io.h"
+#include "kernels.h"
+#include "sparse_matrix.h"
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRACER_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+PixelTracer::PixelTracer(const ImageBuffer& image, unsigned cell_size, unsigned discr_size)
+: _pixels((size_t)image.width() * image.height() + 4, 0), _size(image.size()), _cell_size(cell_size), _discr_size(discr_size)
+{
+    memcpy(_pixels.data(), image.data(), (size_t)image.width() * image.height());
+}
+
+/* Estado de hasta 8 rayos, uno por carril, guardado por campo para
+ * cargarlo directamente en los registros.
+ *
+ * Un rayo es la recta que pasa por los centros de los pixeles (x0,y0)
+ * y (x1,y1), con el eje y de arriba hacia abajo. Para que las
+ * comparaciones con los bordes de los pixeles sean exactas (y el
+ * recorrido no dependa del redondeo cuando la recta pasa justo por una
+ * esquina) se trabaja con enteros, en coordenadas multiplicadas por 4.
+ * El recorrido avanza siempre en x hacia la derecha y en y en un solo
+ * sentido, asi que los pixeles de una misma celda (que es convexa) se
+ * visitan todos seguidos, y basta con contar los de la celda actual.
+ *
+ * En cada pixel se lleva la diferencia e entre la altura de la recta en
+ * el borde derecho del pixel y el borde de arriba (las dos multiplicadas
+ * por 4*DX). Cada paso suma o resta 4*DX o 4*DY, asi que no hay
+ * multiplicaciones ni divisiones dentro del ciclo:
+ *
+ *   e == 0:          x++, y--   (esquina de arriba)
+ *   e == 4*DX:       x++, y++   (esquina de abajo)
+ *   e < 0:           y--
+ *   0 < e < 4*DX:    x++
+ *   4*DX < e:        y++
+ *
+ * es decir, x avanza si 0 <= e <= 4*DX, y baja si e <= 0 y sube si
+ * e >= 4*DX. Tambien se llevan la posicion dentro de la imagen, la
+ * celda (columna cx, comienzo de fila row) y el resto de x e y modulo
+ * el tamaño de celda, para no dividir por pixel. */
+struct Lanes
+{
+    int64_t e[8];
+    int64_t dx4[8];
+    int64_t dy4[8];
+    int64_t x[8];
+    int64_t y[8];
+    int64_t index[8];
+    int64_t rx[8];
+    int64_t ry[8];
+    int64_t cx[8];
+    int64_t row[8];
+    int64_t cell[8];
+    int64_t count[8];
+    int64_t time[8];
+};
+
+/* Carga el rayo en el carril k. Se empieza por el extremo de la
+ * izquierda; si el rayo es vertical se lo "tuerce" un poco y, por
+ * convencion, se empieza en (x0,y0). */
+static void start_lane(const Ray& ray, unsigned n, unsigned cell_size, unsigned discr_size, Lanes& L, unsigned k)
+{
+    int64_t X0 = 4*(int64_t)ray.x0 + 2;
+    int64_t Y0 = 4*(int64_t)ray.y0 + 2;
+    int64_t X1 = 4*(int64_t)ray.x1 + 2;
+    int64_t Y1 = 4*(int64_t)ray.y1 + 2;
+    
+    int64_t x, y;
+    if (ray.x0 < ray.x1) {
+        x = ray.x0;
+        y = ray.y0;
+    }
+    else if (ray.x1 < ray.x0) {
+        x = ray.x1;
+        y = ray.y1;
+    }
+    else {
+        x = ray.x0;
+        y = ray.y0;
+        X0 -= 1;
+        X1 += 1;
+    }
+    if (X1 < X0) {
+        swap(X0, X1);
+        swap(Y0, Y1);
+    }
+    int64_t DX = X1 - X0;
+    int64_t DY = Y1 - Y0;
+    
+    L.e[k] = Y0*DX + (4*(x + 1) - X0)*DY - 4*y*DX;
+    L.dx4[k] = 4*DX;
+    L.dy4[k] = 4*DY;
+    L.x[k] = x;
+    L.y[k] = y;
+    L.index[k] = y * n + x;
+    L.rx[k] = x % cell_size;
+    L.ry[k] = y % cell_size;
+    L.cx[k] = x / cell_size;
+    L.row[k] = (y / cell_size) * discr_size;
+    L.cell[k] = 0;
+    L.count[k] = 0;
+    L.time[k] = 0;
+}
+
+/* Carril vacio (fuera de la imagen desde el principio). */
+static void empty_lane(unsigned n, Lanes& L, unsigned k)
+{
+    start_lane(Ray(0, 0, 1, 0), n, 1, 1, L, k);
+    L.x[k] = n;
+}
+
+/* Al terminar la tanda se emite la ultima celda de cada rayo y se
+ * pasan los elementos de cada carril a hits, en orden de rayo. */
+static void finish_lanes(const Lanes& L, unsigned lanes, unsigned first, double* times, vector<Triplet>* hits, vector<Triplet>* lane_hits)
+{
+    for (unsigned k = 0; k < lanes; k++) {
+        times[k] = (double)L.time[k];
+        if (hits != 0) {
+            if (L.count[k] != 0) {
+                lane_hits[k].push_back(Triplet(first + k, L.cell[k], (double)L.count[k]));
+            }
+            hits->insert(hits->end(), lane_hits[k].begin(), lane_hits[k].end());
+            lane_hits[k].clear();
+        }
+    }
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Escalar ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+static void trace_scalar(const unsigned char* pixels, unsigned n, unsigned cell_size, unsigned discr_size, const Ray* rays, unsigned count, unsigned first, double* times, vector<Triplet>* hits)
+{
+    vector<Triplet> lane_hits[1];
+    for (unsigned r = 0; r < count; r++) {
+        Lanes L;
+        start_lane(rays[r], n, cell_size, discr_size, L, 0);
+        int64_t e = L.e[0], dx4 = L.dx4[0], dy4 = L.dy4[0];
+        int64_t x = L.x[0], y = L.y[0], index = L.index[0];
+        int64_t rx = L.rx[0], ry = L.ry[0], cx = L.cx[0], row = L.row[0];
+        int64_t cell = 0, cells = 0, time = 0;
+        
+        while (x < (int64_t)n and y >= 0 and y < (int64_t)n) {
+            time += pixels[index];
+            if (hits != 0) {
+                if (row + cx != cell and cells != 0) {
+                    lane_hits[0].push_back(Triplet(first + r, cell, (double)cells));
+                    cells = 0;
+                }
+                cell = row + cx;
+                cells++;
+            }
+            
+            bool step_x = e >= 0 and e <= dx4;
+            bool down = e <= 0;
+            bool up = e >= dx4;
+            if (step_x) {
+                e += dy4;
+                x++;
+                index++;
+                if (++rx == cell_size) {
+                    rx = 0;
+                    cx++;
+                }
+            }
+            if (down) {
+                e += dx4;
+                y--;
+                index -= n;
+                if (ry-- == 0) {
+                    ry = cell_size - 1;
+                    row -= discr_size;
+                }
+            }
+            else if (up) {
+                e -= dx4;
+                y++;
+                index += n;
+                if (++ry == cell_size) {
+                    ry = 0;
+                    row += discr_size;
+                }
+            }
+        }
+        
+        L.time[0] = time;
+        L.cell[0] = cell;
+        L.count[0] = cells;
+        finish_lanes(L, 1, first + r, times + r, hits, lane_hits);
+    }
+}
+
+
+#ifdef TRACER_X86
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ AVX2 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+/* Cuatro rayos por registro de 256 bits. Las mascaras son vectores con
+ * todos los bits en 1 en los carriles elegidos; los pixeles se leen
+ * con un gather de 32 bits (de ahi el relleno de la imagen) y se
+ * quedan con el byte bajo. Los carriles que ya salieron de la imagen
+ * leen el pixel 0 y no acumulan nada. */
+__attribute__((target("avx2")))
+static void trace_avx2(const unsigned char* pixels, unsigned n, unsigned cell_size, unsigned discr_size, const Ray* rays, unsigned count, unsigned first, double* times, vector<Triplet>* hits)
+{
+    const unsigned W = 4;
+    vector<Triplet> lane_hits[W];
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i minus_one = _mm256_set1_epi64x(-1);
+    const __m256i size = _mm256_set1_epi64x(n);
+    const __m256i cell_v = _mm256_set1_epi64x(cell_size);
+    const __m256i discr_v = _mm256_set1_epi64x(discr_size);
+    const __m256i low_byte = _mm256_set1_epi64x(0xFF);
+    
+    for (unsigned b = 0; b < count; b += W) {
+        unsigned lanes = min(W, count - b);
+        Lanes L;
+        for (unsigned k = 0; k < W; k++) {
+            if (k < lanes) {
+                start_lane(rays[b + k], n, cell_size, discr_size, L, k);
+            }
+            else {
+                empty_lane(n, L, k);
+            }
+        }
+        
+        __m256i e = _mm256_loadu_si256((const __m256i*)L.e);
+        __m256i dx4 = _mm256_loadu_si256((const __m256i*)L.dx4);
+        __m256i dy4 = _mm256_loadu_si256((const __m256i*)L.dy4);
+        __m256i x = _mm256_loadu_si256((const __m256i*)L.x);
+        __m256i y = _mm256_loadu_si256((const __m256i*)L.y);
+        __m256i index = _mm256_loadu_si256((const __m256i*)L.index);
+        __m256i rx = _mm256_loadu_si256((const __m256i*)L.rx);
+        __m256i ry = _mm256_loadu_si256((const __m256i*)L.ry);
+        __m256i cx = _mm256_loadu_si256((const __m256i*)L.cx);
+        __m256i row = _mm256_loadu_si256((const __m256i*)L.row);
+        __m256i cell = zero, cells = zero, time = zero;
+        
+        __m256i active = _mm256_and_si256(_mm256_cmpgt_epi64(size, x),
+                         _mm256_and_si256(_mm256_cmpgt_epi64(y, minus_one), _mm256_cmpgt_epi64(size, y)));
+        while (_mm256_movemask_pd(_mm256_castsi256_pd(active)) != 0) {
+            __m128i word = _mm256_i64gather_epi32((const int*)pixels, _mm256_and_si256(index, active), 1);
+            __m256i value = _mm256_and_si256(_mm256_cvtepu32_epi64(word), low_byte);
+            time = _mm256_add_epi64(time, _mm256_and_si256(value, active));
+            
+            if (hits != 0) {
+                __m256i current = _mm256_add_epi64(row, cx);
+                __m256i change = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi64(current, cell), _mm256_cmpeq_epi64(cells, zero)), active);
+                int mask = _mm256_movemask_pd(_mm256_castsi256_pd(change));
+                if (mask != 0) {
+                    _mm256_storeu_si256((__m256i*)L.cell, cell);
+                    _mm256_storeu_si256((__m256i*)L.count, cells);
+                    for (unsigned k = 0; k < W; k++) {
+                        if (mask & (1 << k)) {
+                            lane_hits[k].push_back(Triplet(first + b + k, L.cell[k], (double)L.count[k]));
+                        }
+                    }
+                    cells = _mm256_andnot_si256(change, cells);
+                }
+                cell = _mm256_blendv_epi8(cell, current, active);
+                cells = _mm256_add_epi64(cells, _mm256_and_si256(active, one));
+            }
+            
+            __m256i step_x = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi64(zero, e), _mm256_cmpgt_epi64(e, dx4)), active);
+            __m256i down = _mm256_andnot_si256(_mm256_cmpgt_epi64(e, zero), active);
+            __m256i up = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi64(dx4, e), down), active);
+            
+            __m256i step_one = _mm256_and_si256(step_x, one);
+            e = _mm256_add_epi64(e, _mm256_and_si256(step_x, dy4));
+            x = _mm256_add_epi64(x, step_one);
+            index = _mm256_add_epi64(index, step_one);
+            rx = _mm256_add_epi64(rx, step_one);
+            __m256i wrap = _mm256_cmpeq_epi64(rx, cell_v);
+            rx = _mm256_andnot_si256(wrap, rx);
+            cx = _mm256_add_epi64(cx, _mm256_and_si256(wrap, one));
+            
+            __m256i down_one = _mm256_and_si256(down, one);
+            e = _mm256_add_epi64(e, _mm256_and_si256(down, dx4));
+            y = _mm256_sub_epi64(y, down_one);
+            index = _mm256_sub_epi64(index, _mm256_and_si256(down, size));
+            wrap = _mm256_and_si256(down, _mm256_cmpeq_epi64(ry, zero));
+            ry = _mm256_add_epi64(_mm256_sub_epi64(ry, down_one), _mm256_and_si256(wrap, cell_v));
+            row = _mm256_sub_epi64(row, _mm256_and_si256(wrap, discr_v));
+            
+            __m256i up_one = _mm256_and_si256(up, one);
+            e = _mm256_sub_epi64(e, _mm256_and_si256(up, dx4));
+            y = _mm256_add_epi64(y, up_one);
+            index = _mm256_add_epi64(index, _mm256_and_si256(up, size));
+            ry = _mm256_add_epi64(ry, up_one);
+            wrap = _mm256_cmpeq_epi64(ry, cell_v);
+            ry = _mm256_andnot_si256(wrap, ry);
+            row = _mm256_add_epi64(row, _mm256_and_si256(wrap, discr_v));
+            
+            active = _mm256_and_si256(active, _mm256_and_si256(_mm256_cmpgt_epi64(size, x),
+                     _mm256_and_si256(_mm256_cmpgt_epi64(y, minus_one), _mm256_cmpgt_epi64(size, y))));
+        }
+        
+        _mm256_storeu_si256((__m256i*)L.time, time);
+        _mm256_storeu_si256((__m256i*)L.cell, cell);
+        _mm256_storeu_si256((__m256i*)L.count, cells);
+        finish_lanes(L, lanes, first + b, times + b, hits, lane_hits);
+    }
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ AVX-512 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+/* Ocho rayos por registro, con mascaras de bits: las sumas y el gather
+ * se hacen solo en los carriles activos. */
+__attribute__((target("avx512f")))
+static void trace_avx512(const unsigned char* pixels, unsigned n, unsigned cell_size, unsigned discr_size, const Ray* rays, unsigned count, unsigned first, double* times, vector<Triplet>* hits)
+{
+    const unsigned W = 8;
+    vector<Triplet> lane_hits[W];
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i size = _mm512_set1_epi64(n);
+    const __m512i cell_v = _mm512_set1_epi64(cell_size);
+    const __m512i discr_v = _mm512_set1_epi64(discr_size);
+    const __m512i low_byte = _mm512_set1_epi64(0xFF);
+    
+    for (unsigned b = 0; b < count; b += W) {
+        unsigned lanes = min(W, count - b);
+        Lanes L;
+        for (unsigned k = 0; k < W; k++) {
+            if (k < lanes) {
+                start_lane(rays[b + k], n, cell_size, discr_size, L, k);
+            }
+            else {
+                empty_lane(n, L, k);
+            }
+        }
+        
+        __m512i e = _mm512_loadu_si512(L.e);
+        __m512i dx4 = _mm512_loadu_si512(L.dx4);
+        __m512i dy4 = _mm512_loadu_si512(L.dy4);
+        __m512i x = _mm512_loadu_si512(L.x);
+        __m512i y = _mm512_loadu_si512(L.y);
+        __m512i index = _mm512_loadu_si512(L.index);
+        __m512i rx = _mm512_loadu_si512(L.rx);
+        __m512i ry = _mm512_loadu_si512(L.ry);
+        __m512i cx = _mm512_loadu_si512(L.cx);
+        __m512i row = _mm512_loadu_si512(L.row);
+        __m512i cell = zero, cells = zero, time = zero;
+        
+        __mmask8 active = _mm512_cmplt_epi64_mask(x, size) & _mm512_cmpge_epi64_mask(y, zero) & _mm512_cmplt_epi64_mask(y, size);
+        while (active != 0) {
+            __m256i word = _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), active, index, pixels, 1);
+            __m512i value = _mm512_and_si512(_mm512_maskz_cvtepu32_epi64(active, word), low_byte);
+            time = _mm512_mask_add_epi64(time, active, time, value);
+            
+            if (hits != 0) {
+                __m512i current = _mm512_add_epi64(row, cx);
+                __mmask8 change = active & _mm512_cmpneq_epi64_mask(current, cell) & _mm512_cmpneq_epi64_mask(cells, zero);
+                if (change != 0) {
+                    _mm512_storeu_si512(L.cell, cell);
+                    _mm512_storeu_si512(L.count, cells);
+                    for (unsigned k = 0; k < W; k++) {
+                        if (change & (1 << k)) {
+                            lane_hits[k].push_back(Triplet(first + b + k, L.cell[k], (double)L.count[k]));
+                        }
+                    }
+                    cells = _mm512_mask_mov_epi64(cells, change, zero);
+                }
+                cell = _mm512_mask_mov_epi64(cell, active, current);
+                cells = _mm512_mask_add_epi64(cells, active, cells, one);
+            }
+            
+            __mmask8 step_x = active & _mm512_cmpge_epi64_mask(e, zero) & _mm512_cmple_epi64_mask(e, dx4);
+            __mmask8 down = active & _mm512_cmple_epi64_mask(e, zero);
+            __mmask8 up = active & ~down & _mm512_cmpge_epi64_mask(e, dx4);
+            
+            e = _mm512_mask_add_epi64(e, step_x, e, dy4);
+            x = _mm512_mask_add_epi64(x, step_x, x, one);
+            index = _mm512_mask_add_epi64(index, step_x, index, one);
+            rx = _mm512_mask_add_epi64(rx, step_x, rx, one);
+            __mmask8 wrap = _mm512_cmpeq_epi64_mask(rx, cell_v);
+            rx = _mm512_mask_mov_epi64(rx, wrap, zero);
+            cx = _mm512_mask_add_epi64(cx, wrap, cx, one);
+            
+            e = _mm512_mask_add_epi64(e, down, e, dx4);
+            y = _mm512_mask_sub_epi64(y, down, y, one);
+            index = _mm512_mask_sub_epi64(index, down, index, size);
+            wrap = down & _mm512_cmpeq_epi64_mask(ry, zero);
+            ry = _mm512_mask_sub_epi64(ry, down, ry, one);
+            ry = _mm512_mask_add_epi64(ry, wrap, ry, cell_v);
+            row = _mm512_mask_sub_epi64(row, wrap, row, discr_v);
+            
+            e = _mm512_mask_sub_epi64(e, up, e, dx4);
+            y = _mm512_mask_add_epi64(y, up, y, one);
+            index = _mm512_mask_add_epi64(index, up, index, size);
+            ry = _mm512_mask_add_epi64(ry, up, ry, one);
+            wrap = up & _mm512_cmpeq_epi64_mask(ry, cell_v);
+            ry = _mm512_mask_mov_epi64(ry, wrap, zero);
+            row = _mm512_mask_add_epi64(row, wrap, row, discr_v);
+            
+            active &= _mm512_cmplt_epi64_mask(x, size) & _mm512_cmpge_epi64_mask(y, zero) & _mm512_cmplt_epi64_mask(y, size);
+        }
+        
+        _mm512_storeu_si512(L.time, time);
+        _mm512_storeu_si512(L.cell, cell);
+        _mm512_storeu_si512(L.count, cells);
+        finish_lanes(L, lanes, first + b, times + b, hits, lane_hits);
+    }
+}
+
+#endif
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Seleccion ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+void PixelTracer::trace(const Ray* rays, unsigned count, unsigned first, double* times, vector<Triplet>* hits) const
+{
+    const char* level = simd_level();
+#ifdef TRACER_X86
+    if (strcmp(level, "avx512") == 0) {
+        trace_avx512(_pixels.data(), _size, _cell_size, _discr_size, rays, count, first, times, hits);
+        return;
+    }
+    if (strcmp(level, "avx2") == 0) {
+        trace_avx2(_pixels.data(), _size, _cell_size, _discr_size, rays, count, first, times, hits);
+        return;
+    }
+#endif
+    trace_scalar(_pixels.data(), _size, _cell_size, _discr_size, rays, count, first, times, hits);
+}
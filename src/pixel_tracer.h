@@ -0,0 +1,42 @@
+#ifndef PIXEL_TRACER_H
+#define PIXEL_TRACER_H
+
+#include "geometry.h"
+#include <vector>
+
+class ImageBuffer;
+struct Triplet;
+
+/** Trazado por pixeles de rayos entre centros de pixeles, de a tandas.
+ *  Cada rayo recorre los pixeles que atraviesa la recta por los centros
+ *  de sus dos pixeles, decidiendo con aritmetica entera exacta, y se
+ *  avanzan varios rayos a la vez, uno por carril de un registro SIMD: 8
+ *  con AVX-512, 4 con AVX2 y de a uno en la version escalar. Todas dan
+ *  el mismo resultado; la version sale de simd_level() (ver kernels.h),
+ *  asi que tambien se elige con --simd. */
+class PixelTracer
+{
+
+public:
+
+    /** Se guarda una copia de la imagen con unos bytes de relleno al
+     *  final, para poder leer los pixeles de a cuatro bytes. */
+    PixelTracer(const ImageBuffer& image, unsigned cell_size, unsigned discr_size);
+    
+    /** Traza rays[0..count), que son los rayos first, first+1, ...:
+     *  deja en times[k] la suma de los pixeles que visita rays[k] y, si
+     *  hits no es nulo, agrega a hits un elemento (rayo, celda,
+     *  cantidad de pixeles) por cada celda que atraviesa, en orden de
+     *  rayo, igual que RayAccumulator. */
+    void trace(const Ray* rays, unsigned count, unsigned first, double* times, std::vector<Triplet>* hits) const;
+
+private:
+
+    std::vector<unsigned char> _pixels;
+    unsigned _size;
+    unsigned _cell_size;
+    unsigned _discr_size;
+
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+/* Generador basado en contador (Philox4x32-10, de Salmon, Moraes, Dror
+ * y Shaw, "Parallel random numbers: as easy as 1, 2, 3", 2011). No
+ * tiene estado: cada salida es una funcion biyectiva del contador,
+ * mezclada con la clave en 10 rondas, asi que el numero que le toca a
+ * cada (rayo, nivel de ruido) no depende del orden en que se piden ni
+ * de cuantos hilos los piden. La clave es la semilla del programa. */
+
+/** Flujos independientes de numeros al azar (van en el contador, asi
+ *  que dos flujos nunca comparten numeros). */
+enum RandomStream {
+    NOISE_STREAM,
+    RAY_STREAM
+};
+
+inline void philox_round(uint32_t ctr[4], const uint32_t key[2])
+{
+    uint64_t p0 = (uint64_t)0xD2511F53u * ctr[0];
+    uint64_t p1 = (uint64_t)0xCD9E8D57u * ctr[2];
+    uint32_t c0 = (uint32_t)(p1 >> 32) ^ ctr[1] ^ key[0];
+    uint32_t c2 = (uint32_t)(p0 >> 32) ^ ctr[3] ^ key[1];
+    ctr[1] = (uint32_t)p1;
+    ctr[3] = (uint32_t)p0;
+    ctr[0] = c0;
+    ctr[2] = c2;
+}
+
+/** Cuatro enteros de 32 bits para el contador (a, b, stream) con la
+ *  semilla seed. */
+inline void philox4x32(uint64_t seed, uint32_t a, uint32_t b, uint32_t stream, uint32_t out[4])
+{
+    uint32_t key[2] = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+    out[0] = a;
+    out[1] = b;
+    out[2] = stream;
+    out[3] = 0;
+    for (unsigned round = 0; round < 10; round++) {
+        if (round != 0) {
+            key[0] += 0x9E3779B9u;
+            key[1] += 0xBB67AE85u;
+        }
+        philox_round(out, key);
+    }
+}
+
+/** Cuatro numeros uniformes en [0,1) para el contador (a, b, stream). */
+inline void random_uniform4(uint64_t seed, uint32_t a, uint32_t b, uint32_t stream, double u[4])
+{
+    uint32_t bits[4];
+    philox4x32(seed, a, b, stream, bits);
+    for (unsigned k = 0; k < 4; k++) {
+        u[k] = bits[k] * (1.0 / 4294967296.0);
+    }
+}
+
+#endif
@@ -0,0 +1,236 @@
+#include "row_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std;
+
+static bool index_less(const pair<unsigned,double>& a, const pair<unsigned,double>& b)
+{
+    return a.first < b.first;
+}
+
+/* Los elementos de cada fila se ordenan por columna, para que el
+ * producto fila por fila sume en el mismo orden que la copia CSR de
+ * SparseMatrix. */
+void RowChunk::assign(unsigned first, unsigned last, const vector<vector<Triplet> >& blocks)
+{
+    first_row = first;
+    row_ptr.assign(last - first + 1, 0);
+    for (unsigned b = 0; b < blocks.size(); b++) {
+        for (size_t k = 0; k < blocks[b].size(); k++) {
+            row_ptr[blocks[b][k].row - first + 1]++;
+        }
+    }
+    for (unsigned i = 0; i < last - first; i++) {
+        row_ptr[i+1] += row_ptr[i];
+    }
+    
+    col_idx.resize(row_ptr.back());
+    values.resize(row_ptr.back());
+    size_t pos = 0;
+    SparseVector row;
+    for (unsigned b = 0; b < blocks.size(); b++) {
+        const vector<Triplet>& block = blocks[b];
+        for (size_t k = 0; k < block.size(); ) {
+            unsigned r = block[k].row;
+            row.clear();
+            for (; k < block.size() and block[k].row == r; k++) {
+                row.push_back(make_pair(block[k].col, block[k].value));
+            }
+            if (!is_sorted(row.begin(), row.end(), index_less)) {
+                sort(row.begin(), row.end(), index_less);
+            }
+            for (size_t p = 0; p < row.size(); p++, pos++) {
+                col_idx[pos] = row[p].first;
+                values[pos] = row[p].second;
+            }
+        }
+    }
+}
+
+RowFile::~RowFile()
+{
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool RowFile::create(const string& dir, unsigned num_columns)
+{
+    string name = dir + "/tomo_rows_XXXXXX";
+    vector<char> path(name.begin(), name.end());
+    path.push_back('\0');
+    _fd = mkstemp(path.data());
+    if (_fd < 0) {
+        return false;
+    }
+    unlink(path.data());
+    
+    _chunks.clear();
+    _num_rows = 0;
+    _num_columns = num_columns;
+    _num_nonzeros = 0;
+    _size = 0;
+    _failed = false;
+    return true;
+}
+
+/* Escribe o lee bytes completos en la posicion dada, reintentando
+ * las operaciones parciales. */
+static bool write_all(int fd, const void* data, size_t bytes, uint64_t offset)
+{
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        ssize_t done = pwrite(fd, p, bytes, offset);
+        if (done < 0 and errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        p += done;
+        bytes -= done;
+        offset += done;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t bytes, uint64_t offset)
+{
+    char* p = (char*)data;
+    while (bytes > 0) {
+        ssize_t done = pread(fd, p, bytes, offset);
+        if (done < 0 and errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        p += done;
+        bytes -= done;
+        offset += done;
+    }
+    return true;
+}
+
+/* Cada bloque se guarda como row_ptr, col_idx y values seguidos; la
+ * posicion y el tamaño de cada uno quedan en _chunks. */
+bool RowFile::append(const RowChunk& chunk)
+{
+    if (_fd < 0 or chunk.first_row != _num_rows) {
+        return false;
+    }
+    
+    ChunkInfo info;
+    info.first_row = chunk.first_row;
+    info.num_rows = chunk.num_rows();
+    info.num_nonzeros = chunk.col_idx.size();
+    info.offset = _size;
+    
+    size_t ptr_bytes = chunk.row_ptr.size() * sizeof(uint32_t);
+    size_t idx_bytes = info.num_nonzeros * sizeof(unsigned);
+    size_t val_bytes = info.num_nonzeros * sizeof(double);
+    if (!write_all(_fd, chunk.row_ptr.data(), ptr_bytes, _size) or
+        !write_all(_fd, chunk.col_idx.data(), idx_bytes, _size + ptr_bytes) or
+        !write_all(_fd, chunk.values.data(), val_bytes, _size + ptr_bytes + idx_bytes)) {
+        return false;
+    }
+    
+    _chunks.push_back(info);
+    _num_rows += info.num_rows;
+    _num_nonzeros += info.num_nonzeros;
+    _size += ptr_bytes + idx_bytes + val_bytes;
+    return true;
+}
+
+bool RowFile::read(unsigned k, RowChunk& chunk) const
+{
+    const ChunkInfo& info = _chunks[k];
+    chunk.first_row = info.first_row;
+    chunk.row_ptr.resize(info.num_rows + 1);
+    chunk.col_idx.resize(info.num_nonzeros);
+    chunk.values.resize(info.num_nonzeros);
+    
+    size_t ptr_bytes = chunk.row_ptr.size() * sizeof(uint32_t);
+    size_t idx_bytes = info.num_nonzeros * sizeof(unsigned);
+    size_t val_bytes = info.num_nonzeros * sizeof(double);
+    return read_all(_fd, chunk.row_ptr.data(), ptr_bytes, info.offset) and
+           read_all(_fd, chunk.col_idx.data(), idx_bytes, info.offset + ptr_bytes) and
+           read_all(_fd, chunk.values.data(), val_bytes, info.offset + ptr_bytes + idx_bytes) and
+           chunk.row_ptr.back() == info.num_nonzeros;
+}
+
+/* Los dos buffers se reusan durante todo el recorrido, asi que la
+ * memoria es la de los dos bloques mas grandes. */
+void RowFile::for_each(const vector<unsigned>& order, const function<void(const RowChunk&)>& f) const
+{
+    if (order.empty()) {
+        return;
+    }
+    
+    RowChunk buffers[2];
+    bool ok[2];
+    ok[0] = read(order[0], buffers[0]);
+    for (size_t k = 0; k < order.size(); k++) {
+        unsigned current = k % 2;
+        thread prefetch;
+        if (k + 1 < order.size()) {
+            prefetch = thread([this, &order, &buffers, &ok, k, current]() {
+                ok[1 - current] = read(order[k + 1], buffers[1 - current]);
+            });
+        }
+        
+        if (ok[current]) {
+            f(buffers[current]);
+        }
+        else {
+            _failed = true;
+        }
+        
+        if (prefetch.joinable()) {
+            prefetch.join();
+        }
+    }
+}
+
+void RowFile::for_each(const function<void(const RowChunk&)>& f) const
+{
+    vector<unsigned> order(_chunks.size());
+    for (unsigned k = 0; k < order.size(); k++) {
+        order[k] = k;
+    }
+    for_each(order, f);
+}
+
+vector<double> operator*(const RowFile& A, const vector<double>& v)
+{
+    vector<double> res(A.num_rows(), 0.0);
+    A.for_each([&](const RowChunk& chunk) {
+        for (unsigned i = 0; i < chunk.num_rows(); i++) {
+            double temp = 0.0;
+            for (size_t k = chunk.row_ptr[i]; k < chunk.row_ptr[i+1]; k++) {
+                temp += chunk.values[k] * v[chunk.col_idx[k]];
+            }
+            res[chunk.first_row + i] = temp;
+        }
+    });
+    return res;
+}
+
+vector<double> transposed_product(const RowFile& A, const vector<double>& v)
+{
+    vector<double> res(A.num_columns(), 0.0);
+    A.for_each([&](const RowChunk& chunk) {
+        for (unsigned i = 0; i < chunk.num_rows(); i++) {
+            double vi = v[chunk.first_row + i];
+            for (size_t k = chunk.row_ptr[i]; k < chunk.row_ptr[i+1]; k++) {
+                res[chunk.col_idx[k]] += chunk.values[k] * vi;
+            }
+        }
+    });
+    return res;
+}
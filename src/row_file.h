@@ -0,0 +1,135 @@
+#ifndef ROW_FILE_H
+#define ROW_FILE_H
+
+#include "sparse_matrix.h"
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/** Bloque de filas consecutivas de una matriz rala, en formato CSR:
+ *  las filas first_row, first_row+1, ..., con los indices de columna
+ *  de cada fila ordenados (como en la copia CSR de SparseMatrix).
+ *  row_ptr es relativo al bloque. */
+struct RowChunk
+{
+    unsigned first_row;
+    std::vector<uint32_t> row_ptr;
+    std::vector<unsigned> col_idx;
+    std::vector<double> values;
+    
+    RowChunk() : first_row(0), row_ptr(1, 0) {}
+    
+    unsigned num_rows() const {
+        return row_ptr.size() - 1;
+    }
+    
+    /** Fila first_row + i. */
+    SparseVectorView get_row(unsigned i) const {
+        return SparseVectorView(col_idx.data() + row_ptr[i], values.data() + row_ptr[i], row_ptr[i+1] - row_ptr[i]);
+    }
+    
+    /** Arma el bloque con las filas [first, last) a partir de bloques
+     *  de elementos en orden de fila, como los del constructor de
+     *  SparseMatrix. */
+    void assign(unsigned first, unsigned last, const std::vector<std::vector<Triplet> >& blocks);
+};
+
+/** Matriz rala guardada por bloques de filas en un archivo temporal,
+ *  para las D que no entran en memoria. Los bloques se agregan en
+ *  orden de fila y despues se recorren de a uno: en memoria quedan
+ *  solo el bloque que se esta usando y el siguiente, que se lee en
+ *  otro hilo mientras tanto. El archivo se borra apenas se crea, asi
+ *  que desaparece al cerrarlo (o si el programa termina de cualquier
+ *  forma). No se puede copiar. */
+class RowFile
+{
+
+public:
+
+    RowFile() : _fd(-1), _num_rows(0), _num_columns(0), _num_nonzeros(0), _size(0), _failed(false) {}
+    
+    ~RowFile();
+    
+    RowFile(const RowFile& other) = delete;
+    RowFile& operator=(const RowFile& other) = delete;
+    
+    /** Crea el archivo, vacio, en el directorio dir, para una matriz de
+     *  num_columns columnas. Devuelve falso si no se pudo crear. */
+    bool create(const std::string& dir, unsigned num_columns);
+    
+    /** Agrega las filas del bloque, que tienen que ser las siguientes a
+     *  las ya agregadas. Devuelve falso si no se pudo escribir. */
+    bool append(const RowChunk& chunk);
+    
+    unsigned num_rows() const {
+        return _num_rows;
+    }
+    
+    unsigned num_columns() const {
+        return _num_columns;
+    }
+    
+    size_t num_nonzeros() const {
+        return _num_nonzeros;
+    }
+    
+    unsigned num_chunks() const {
+        return _chunks.size();
+    }
+    
+    /** Primera fila del bloque k y primera fila despues del bloque. */
+    unsigned chunk_begin(unsigned k) const {
+        return _chunks[k].first_row;
+    }
+    
+    unsigned chunk_end(unsigned k) const {
+        return _chunks[k].first_row + _chunks[k].num_rows;
+    }
+    
+    /** Llama a f con los bloques order[0], order[1], ..., en ese orden.
+     *  Mientras f procesa un bloque, el siguiente se lee en otro hilo
+     *  (en un segundo buffer), asi que la lectura del disco se superpone
+     *  con las cuentas. Si un bloque no se puede leer no se llama a f
+     *  con el y queda marcado el error (ver failed). */
+    void for_each(const std::vector<unsigned>& order, const std::function<void(const RowChunk&)>& f) const;
+    
+    /** Lo mismo, con todos los bloques en orden. */
+    void for_each(const std::function<void(const RowChunk&)>& f) const;
+    
+    /** Verdadero si alguna lectura fallo. */
+    bool failed() const {
+        return _failed;
+    }
+    
+private:
+
+    struct ChunkInfo
+    {
+        unsigned first_row;
+        unsigned num_rows;
+        size_t num_nonzeros;
+        uint64_t offset;
+    };
+    
+    bool read(unsigned k, RowChunk& chunk) const;
+    
+    int _fd;
+    std::vector<ChunkInfo> _chunks;
+    unsigned _num_rows;
+    unsigned _num_columns;
+    size_t _num_nonzeros;
+    uint64_t _size;
+    mutable bool _failed;
+
+};
+
+/** Producto A*v, recorriendo el archivo una vez. Da lo mismo, bit a
+ *  bit, que el producto por la SparseMatrix con las mismas filas. */
+std::vector<double> operator*(const RowFile& A, const std::vector<double>& v);
+
+/** Producto A^t*v, recorriendo el archivo una vez. Cada elemento se
+ *  acumula en orden de fila, igual que transposed_product sobre la CSC. */
+std::vector<double> transposed_product(const RowFile& A, const std::vector<double>& v);
+
+#endif
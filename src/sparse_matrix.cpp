@@ -1,91 +1,391 @@
 #include "sparse_matrix.h"
 #include "matrix.h"
+#include "factorization.h"
 #include "metrics.h"
+#include "parallel.h"
+#include "kernels.h"
 #include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <ctime>
-#include <limits>
-
-#include <iostream>
 
 using namespace std;
 
-static const double epsilon = numeric_limits<double>::epsilon();
-
+static bool index_less(const pair<unsigned,double>& a, const pair<unsigned,double>& b)
+{
+    return a.first < b.first;
+}
 
-Matrix SparseMatrix::get_AtA_product() const
+template <class T>
+void BasicSparseMatrix<T>::compress(bool with_rows)
 {
-    unsigned n = _columns.size();
-    Matrix AtA(n, n);
+    if (_compressed) {
+        return;
+    }
     
-    for (unsigned i = 0; i < n; i++) {
-        for (unsigned j = 0; j <= i; j++) {
-            AtA(i,j) = inner_product(_columns[i], _columns[j]);
-            AtA(j,i) = AtA(i,j);
+    _col_ptr.assign(_num_columns + 1, 0);
+    for (unsigned j = 0; j < _num_columns; j++) {
+        _col_ptr[j+1] = _col_ptr[j] + _columns[j].size();
+    }
+    
+    _row_idx.resize(_col_ptr[_num_columns]);
+    _values.resize(_col_ptr[_num_columns]);
+    
+    for (unsigned j = 0; j < _num_columns; j++) {
+        SparseVector& col = _columns[j];
+        if (!is_sorted(col.begin(), col.end(), index_less)) {
+            sort(col.begin(), col.end(), index_less);
+        }
+        size_t pos = _col_ptr[j];
+        for (unsigned elem = 0; elem < col.size(); elem++) {
+            _row_idx[pos + elem] = col[elem].first;
+            _values[pos + elem] = col[elem].second;
         }
+        // Liberamos la memoria de la columna a medida que la copiamos
+        SparseVector().swap(col);
     }
+    vector<SparseVector>().swap(_columns);
     
-    return AtA;
+    bind_owned();
+    
+    if (with_rows) {
+        build_rows();
+    }
 }
 
-Vector operator*(const SparseMatrix& mat, const Vector& v)
+template <class T>
+BasicSparseMatrix<T>::BasicSparseMatrix(unsigned num_rows, unsigned num_columns, const vector<vector<Triplet> >& blocks, bool with_rows)
+: _num_rows(num_rows), _num_columns(num_columns)
 {
-    Vector res(mat.num_rows(), 0.0);
+    _col_ptr.assign(_num_columns + 1, 0);
+    for (unsigned b = 0; b < blocks.size(); b++) {
+        for (size_t k = 0; k < blocks[b].size(); k++) {
+            _col_ptr[blocks[b][k].col + 1]++;
+        }
+    }
+    for (unsigned j = 0; j < _num_columns; j++) {
+        _col_ptr[j+1] += _col_ptr[j];
+    }
     
-    for (unsigned j = 0; j < mat.num_columns(); j++) {
-        const SparseVector& col = mat.get_column(j);
-        for (unsigned elem = 0; elem < col.size(); elem++) {
-            res[col[elem].first] += col[elem].second * v[j];
+    _row_idx.resize(_col_ptr[_num_columns]);
+    _values.resize(_col_ptr[_num_columns]);
+    
+    vector<size_t> next(_col_ptr.begin(), _col_ptr.end() - 1);
+    for (unsigned b = 0; b < blocks.size(); b++) {
+        for (size_t k = 0; k < blocks[b].size(); k++) {
+            const Triplet& t = blocks[b][k];
+            size_t pos = next[t.col]++;
+            _row_idx[pos] = t.row;
+            _values[pos] = t.value;
         }
     }
     
-    return res;
+    bind_owned();
+    
+    if (with_rows) {
+        build_rows();
+    }
 }
 
+template <class T>
+BasicSparseMatrix<T>::BasicSparseMatrix(unsigned num_rows, unsigned num_columns, const size_t* col_ptr, const unsigned* row_idx, const T* values, shared_ptr<const void> storage, bool with_rows)
+: _csc_col_ptr(col_ptr), _csc_row_idx(row_idx), _csc_values(values), _storage(storage),
+  _num_rows(num_rows), _num_columns(num_columns), _compressed(true)
+{
+    if (with_rows) {
+        build_rows();
+    }
+}
 
-vector<Vector> least_squares(const SparseMatrix& A, const vector<Vector>& bs, Metrics& metrics)
+template <class T>
+template <class U>
+BasicSparseMatrix<T>::BasicSparseMatrix(const BasicSparseMatrix<U>& other, bool with_rows)
+: _col_ptr(other.col_ptr(), other.col_ptr() + other.num_columns() + 1),
+  _row_idx(other.row_indices(), other.row_indices() + other.num_nonzeros()),
+  _values(other.values(), other.values() + other.num_nonzeros()),
+  _num_rows(other.num_rows()), _num_columns(other.num_columns())
 {
-    clock_t start = clock();
-    
-    unsigned m = A.num_rows(); unsigned n = A.num_columns();
+    bind_owned();
     
-    Matrix AtA = A.get_AtA_product();
+    if (with_rows) {
+        build_rows();
+    }
+}
+
+template <class T>
+void BasicSparseMatrix<T>::bind_owned()
+{
+    _csc_col_ptr = _col_ptr.data();
+    _csc_row_idx = _row_idx.data();
+    _csc_values = _values.data();
+    _compressed = true;
+}
+
+/* Arma la copia CSR con un counting sort sobre los indices de fila. 
+ * Como las columnas se recorren en orden, los indices de columna 
+ * de cada fila quedan ordenados. */
+template <class T>
+void BasicSparseMatrix<T>::build_rows()
+{
+    _row_ptr.assign(_num_rows + 1, 0);
+    size_t nnz = num_nonzeros();
+    for (size_t k = 0; k < nnz; k++) {
+        _row_ptr[_csc_row_idx[k] + 1]++;
+    }
+    for (unsigned i = 0; i < _num_rows; i++) {
+        _row_ptr[i+1] += _row_ptr[i];
+    }
     
-    vector<double> evalues;
-    vector<Vector> evectors;
-    AtA.find_eigen(evalues, evectors);
+    _col_idx.resize(nnz);
+    _row_values.resize(nnz);
     
-    Vector svalues(evalues.size());
-    for (unsigned i = 0; i < svalues.size(); i++) {
-        svalues[i] = sqrt(evalues[i]);
+    vector<size_t> next(_row_ptr.begin(), _row_ptr.end() - 1);
+    for (unsigned j = 0; j < _num_columns; j++) {
+        for (size_t k = _csc_col_ptr[j]; k < _csc_col_ptr[j+1]; k++) {
+            size_t pos = next[_csc_row_idx[k]]++;
+            _col_idx[pos] = j;
+            _row_values[pos] = _csc_values[k];
+        }
     }
+}
+
+template <class T>
+static double inner_product(const BasicSparseVectorView<T>& u, const BasicSparseVectorView<T>& v)
+{
+    size_t i = 0, j = 0;
+    double res = 0.0;
+    while (i < u.size() and j < v.size()) {
+        if (u.index(i) == v.index(j)) {
+            res += u.value(i) * v.value(j);
+            i++;
+            j++;
+        }
+        else if (u.index(i) < v.index(j)) {
+            i++;
+        }
+        else {
+            j++;
+        }
+    }
+    
+    return res;
+}
 
-    Matrix Ut(svalues.size(), m);
-    for (unsigned i = 0; i < svalues.size(); i++) {
-        Ut.set_row(i, A*evectors[i] / svalues[i]);
+/* Si esta la copia CSR, A^t*A se arma como la suma de los productos 
+ * externos de las filas de A (cada rayo solo aporta en los pares de 
+ * celdas por las que pasa), en vez de calcular los n^2/2 productos 
+ * internos entre columnas, que en su mayoria dan cero.
+ *
+ * Cada hilo es dueño de un rango contiguo de filas a de A^t*A, y 
+ * recorre solo las filas de A que pasan por esas columnas (las de la 
+ * columna a en la CSC), asi que entre todos leen cada elemento una 
+ * vez. Los rangos se eligen para que el trabajo (los productos de 
+ * cada fila a) quede parejo. No hace falta reducir resultados 
+ * parciales, y como cada elemento se acumula siempre en el orden de 
+ * las filas de A, el resultado es el mismo bit a bit para cualquier 
+ * cantidad de hilos. Se arma solo el triangulo inferior y despues se 
+ * copia al superior. */
+template <class T>
+Matrix BasicSparseMatrix<T>::get_AtA_product() const
+{
+    unsigned n = _num_columns;
+    Matrix AtA(n, n);
+    
+    if (!has_rows()) {
+        for (unsigned i = 0; i < n; i++) {
+            for (unsigned j = 0; j <= i; j++) {
+                AtA(i,j) = inner_product(get_column(i), get_column(j));
+                AtA(j,i) = AtA(i,j);
+            }
+        }
+        return AtA;
     }
+    
+    // Trabajo acumulado hasta cada fila a: cada elemento (r,a) de A 
+    // cuesta tantos productos como elementos hay antes en la fila r
+    vector<double> work(n + 1, 0.0);
+    for (unsigned r = 0; r < _num_rows; r++) {
+        for (size_t p = _row_ptr[r]; p < _row_ptr[r+1]; p++) {
+            work[_col_idx[p] + 1] += p - _row_ptr[r] + 1;
+        }
+    }
+    for (unsigned a = 0; a < n; a++) {
+        work[a+1] += work[a];
+    }
+    
+    unsigned threads = num_threads();
+    vector<unsigned> first(threads + 1, n);
+    for (unsigned t = 0; t < threads; t++) {
+        double target = work[n] * t / threads;
+        first[t] = lower_bound(work.begin(), work.end() - 1, target) - work.begin();
+    }
+    
+    const size_t* csc_ptr = col_ptr();
+    const unsigned* csc_rows = row_indices();
+    parallel_for(threads, [&](unsigned t, unsigned, unsigned) {
+        for (unsigned a = first[t]; a < first[t+1]; a++) {
+            unsigned last_row = _num_rows;
+            size_t p = 0;
+            for (size_t k = csc_ptr[a]; k < csc_ptr[a+1]; k++) {
+                unsigned r = csc_rows[k];
+                size_t begin = _row_ptr[r];
+                // Si la fila repite la columna a, se sigue desde el 
+                // elemento anterior
+                p = r == last_row ? p + 1 : begin;
+                while (_col_idx[p] != a) {
+                    p++;
+                }
+                last_row = r;
+                double va = _row_values[p];
+                // Los indices de columna de cada fila estan ordenados, 
+                // asi que los b <= a son los anteriores a p
+                for (size_t q = begin; q <= p; q++) {
+                    AtA(a, _col_idx[q]) += va * _row_values[q];
+                }
+            }
+        }
+    }, threads);
+    
+    parallel_for(n, [&](unsigned, unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+            for (unsigned j = 0; j < i; j++) {
+                AtA(j,i) = AtA(i,j);
+            }
+        }
+    });
+    
+    return AtA;
+}
 
-    Matrix V(n, svalues.size());
-    for (unsigned j = 0; j < svalues.size(); j++) {
-        V.set_column(j, evectors[j]);
+/* Si esta la copia CSR cada elemento del resultado se calcula como 
+ * el producto interno de una fila con v (lecturas contiguas, sin 
+ * escrituras dispersas). Si no, se recorre la CSC dispersando. */
+template <class T, class U>
+vector<U> operator*(const BasicSparseMatrix<T>& mat, const vector<U>& v)
+{
+    vector<U> res(mat.num_rows(), 0.0);
+    
+    if (mat.has_rows()) {
+        const size_t* row_ptr = mat.row_ptr();
+        const unsigned* col_idx = mat.column_indices();
+        const T* values = mat.row_values();
+        for (unsigned i = 0; i < mat.num_rows(); i++) {
+            U temp = 0.0;
+            for (size_t k = row_ptr[i]; k < row_ptr[i+1]; k++) {
+                temp += values[k] * v[col_idx[k]];
+            }
+            res[i] = temp;
+        }
+    }
+    else {
+        const size_t* col_ptr = mat.col_ptr();
+        const unsigned* row_idx = mat.row_indices();
+        const T* values = mat.values();
+        for (unsigned j = 0; j < mat.num_columns(); j++) {
+            U vj = v[j];
+            for (size_t k = col_ptr[j]; k < col_ptr[j+1]; k++) {
+                res[row_idx[k]] += values[k] * vj;
+            }
+        }
     }
     
-    vector<Vector> results(bs.size());
+    return res;
+}
+
+template <class T, class U>
+vector<U> transposed_product(const BasicSparseMatrix<T>& mat, const vector<U>& v)
+{
+    vector<U> res(mat.num_columns(), 0.0);
     
-    for (unsigned k = 0; k < bs.size(); k++) {
-        Vector c = Ut*bs[k];
+    const size_t* col_ptr = mat.col_ptr();
+    const unsigned* row_idx = mat.row_indices();
+    const T* values = mat.values();
+    for (unsigned j = 0; j < mat.num_columns(); j++) {
+        U temp = 0.0;
+        for (size_t k = col_ptr[j]; k < col_ptr[j+1]; k++) {
+            temp += values[k] * v[row_idx[k]];
+        }
+        res[j] = temp;
+    }
+    
+    return res;
+}
 
-        Vector y(svalues.size());
-        for (unsigned i = 0; i < y.size(); i++) {
-            y[i] = c[i] / svalues[i];
+/* Cada fila del resultado es una combinacion lineal de filas de X, 
+ * asi que con la copia CSR las filas se reparten entre los hilos. Sin 
+ * ella se recorre la CSC dispersando filas enteras. */
+Matrix operator*(const SparseMatrix& mat, const Matrix& X)
+{
+    unsigned r = X.num_columns();
+    Matrix res(mat.num_rows(), r);
+    
+    if (mat.has_rows()) {
+        const size_t* row_ptr = mat.row_ptr();
+        const unsigned* col_idx = mat.column_indices();
+        const double* values = mat.row_values();
+        parallel_for(mat.num_rows(), [&](unsigned, unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; i++) {
+                double* y = &res(i,0);
+                for (size_t k = row_ptr[i]; k < row_ptr[i+1]; k++) {
+                    axpy(values[k], &X(col_idx[k],0), y, r);
+                }
+            }
+        });
+    }
+    else {
+        const size_t* col_ptr = mat.col_ptr();
+        const unsigned* row_idx = mat.row_indices();
+        const double* values = mat.values();
+        for (unsigned j = 0; j < mat.num_columns(); j++) {
+            const double* x = &X(j,0);
+            for (size_t k = col_ptr[j]; k < col_ptr[j+1]; k++) {
+                axpy(values[k], x, &res(row_idx[k],0), r);
+            }
         }
-        
-        results[k] = V*y;
     }
+    
+    return res;
+}
+
+Matrix transposed_product(const SparseMatrix& mat, const Matrix& Y)
+{
+    unsigned r = Y.num_columns();
+    Matrix res(mat.num_columns(), r);
+    
+    const size_t* col_ptr = mat.col_ptr();
+    const unsigned* row_idx = mat.row_indices();
+    const double* values = mat.values();
+    parallel_for(mat.num_columns(), [&](unsigned, unsigned begin, unsigned end) {
+        for (unsigned j = begin; j < end; j++) {
+            double* z = &res(j,0);
+            for (size_t k = col_ptr[j]; k < col_ptr[j+1]; k++) {
+                axpy(values[k], &Y(row_idx[k],0), z, r);
+            }
+        }
+    });
+    
+    return res;
+}
 
-    metrics.reconstruction_time = (double)(clock() - start) / CLOCKS_PER_SEC;
-    metrics.cond_number = evalues[0] / evalues.back();
-    metrics.num_eigen_found = evalues.size();
+template class BasicSparseMatrix<double>;
+template class BasicSparseMatrix<float>;
+template BasicSparseMatrix<float>::BasicSparseMatrix(const BasicSparseMatrix<double>& other, bool with_rows);
+
+template vector<double> operator*(const BasicSparseMatrix<double>& mat, const vector<double>& v);
+template vector<float> operator*(const BasicSparseMatrix<float>& mat, const vector<float>& v);
+template vector<double> operator*(const BasicSparseMatrix<float>& mat, const vector<double>& v);
+template vector<double> transposed_product(const BasicSparseMatrix<double>& mat, const vector<double>& v);
+template vector<float> transposed_product(const BasicSparseMatrix<float>& mat, const vector<float>& v);
+template vector<double> transposed_product(const BasicSparseMatrix<float>& mat, const vector<double>& v);
+
+vector<Vector> least_squares(const SparseMatrix& A, const vector<Vector>& bs, const EigenParams& params, const Regularization& reg, Metrics& metrics)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    Factorization F;
+    factorize(A, params, F);
+    vector<Vector> results = solve(F, bs, reg, metrics);
+
+    metrics.reconstruction_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
     
     return results;
-}
\ No newline at end of file
+}
@@ -2,49 +2,238 @@
 #define SPARSE_MATRIX_H
 
 #include "vector.h"
+#include <cstddef>
+#include <memory>
 
 class Matrix;
 
-class SparseMatrix
+/** Elemento (row, col, value) de una matriz rala. */
+struct Triplet
+{
+    unsigned row;
+    unsigned col;
+    double value;
+    
+    Triplet(unsigned r, unsigned c, double v) : row(r), col(c), value(v) {}
+};
+
+/** Vista de solo lectura de una fila o columna de una SparseMatrix 
+ *  comprimida. Se indexa igual que un SparseVector, pero los pares 
+ *  (indice, valor) se devuelven por copia. */
+template <class T>
+class BasicSparseVectorView
 {
 
 public:
 
-    SparseMatrix() {}
+    BasicSparseVectorView(const unsigned* indices, const T* values, size_t size)
+    : _indices(indices), _values(values), _size(size) {}
     
-    SparseMatrix(unsigned num_rows, unsigned num_columns)
-    : _columns(num_columns), _num_rows(num_rows) {}
+    size_t size() const {
+        return _size;
+    }
+    
+    unsigned index(size_t k) const {
+        return _indices[k];
+    }
+    
+    T value(size_t k) const {
+        return _values[k];
+    }
+    
+    std::pair<unsigned,T> operator[](size_t k) const {
+        return std::make_pair(_indices[k], _values[k]);
+    }
+    
+private:
+
+    const unsigned* _indices;
+    const T* _values;
+    size_t _size;
+
+};
+
+typedef BasicSparseVectorView<double> SparseVectorView;
+
+/** Matriz rala. Se arma columna por columna con get_column (cada 
+ *  columna es un SparseVector), y luego se llama a compress(), que la 
+ *  pasa a formato CSC (arreglos contiguos col_ptr/row_idx/values) y 
+ *  opcionalmente arma ademas su copia CSR. Los productos solo se 
+ *  pueden hacer sobre la matriz comprimida.
+ *
+ *  Los arreglos CSC pueden ser propios o externos (por ejemplo, un 
+ *  archivo mapeado en memoria), por eso la matriz no se puede copiar, 
+ *  solo mover.
+ *
+ *  T es el tipo de los valores: SparseMatrix los guarda en double y 
+ *  SparseMatrixF en float, que alcanza para las longitudes de D (en el 
+ *  trazado por pixeles son enteros chicos, que float representa 
+ *  exactamente) y reduce a 8 bytes por elemento lo que se lee en cada 
+ *  producto, en vez de 12. Se instancia solo para esos dos tipos. */
+template <class T>
+class BasicSparseMatrix
+{
+
+public:
+
+    BasicSparseMatrix()
+    : _csc_col_ptr(0), _csc_row_idx(0), _csc_values(0), _num_rows(0), _num_columns(0), _compressed(false) {}
+    
+    BasicSparseMatrix(unsigned num_rows, unsigned num_columns)
+    : _columns(num_columns), _csc_col_ptr(0), _csc_row_idx(0), _csc_values(0),
+      _num_rows(num_rows), _num_columns(num_columns), _compressed(false) {}
+    
+    /** Arma la matriz ya comprimida a partir de bloques de elementos, 
+     *  sin pasar por las columnas de armado. Los elementos de cada 
+     *  columna quedan en el orden en que aparecen recorriendo los 
+     *  bloques en orden, que deberia ser el orden de las filas. No 
+     *  puede haber dos elementos con la misma posicion. */
+    BasicSparseMatrix(unsigned num_rows, unsigned num_columns, const std::vector<std::vector<Triplet> >& blocks, bool with_rows = true);
+    
+    /** Arma la matriz comprimida sobre arreglos CSC externos, sin 
+     *  copiarlos. storage se mantiene vivo mientras viva la matriz 
+     *  (es lo que libera los arreglos, por ejemplo desmapeando el 
+     *  archivo). La copia CSR, si se pide, se arma en memoria. */
+    BasicSparseMatrix(unsigned num_rows, unsigned num_columns, const size_t* col_ptr, const unsigned* row_idx, const T* values, std::shared_ptr<const void> storage, bool with_rows = true);
+    
+    /** Copia de una matriz comprimida con los valores convertidos a T 
+     *  (por ejemplo, D en precision simple). */
+    template <class U>
+    explicit BasicSparseMatrix(const BasicSparseMatrix<U>& other, bool with_rows = true);
+    
+    BasicSparseMatrix(BasicSparseMatrix&& other) = default;
+    BasicSparseMatrix& operator=(BasicSparseMatrix&& other) = default;
+    BasicSparseMatrix(const BasicSparseMatrix& other) = delete;
+    BasicSparseMatrix& operator=(const BasicSparseMatrix& other) = delete;
     
     unsigned num_rows() const {
         return _num_rows;
     }
     
     unsigned num_columns() const {
-        return _columns.size();
+        return _num_columns;
+    }
+    
+    size_t num_nonzeros() const {
+        return _compressed ? _csc_col_ptr[_num_columns] : 0;
     }
     
+    bool is_compressed() const {
+        return _compressed;
+    }
+    
+    bool has_rows() const {
+        return !_row_ptr.empty();
+    }
+    
+    /** Columna j en formato de armado. Solo es valido antes de 
+     *  llamar a compress(). */
     SparseVector& get_column(unsigned j) {
         return _columns[j];
     }
 
-    const SparseVector& get_column(unsigned j) const {
-        return _columns[j];
+    /** Columna j de la matriz comprimida. */
+    BasicSparseVectorView<T> get_column(unsigned j) const {
+        return BasicSparseVectorView<T>(_csc_row_idx + _csc_col_ptr[j], _csc_values + _csc_col_ptr[j], _csc_col_ptr[j+1] - _csc_col_ptr[j]);
+    }
+    
+    /** Fila i de la matriz comprimida. Requiere que se haya armado 
+     *  la copia CSR. */
+    BasicSparseVectorView<T> get_row(unsigned i) const {
+        return BasicSparseVectorView<T>(_col_idx.data() + _row_ptr[i], _row_values.data() + _row_ptr[i], _row_ptr[i+1] - _row_ptr[i]);
+    }
+    
+    /** Arreglos CSC de la matriz comprimida. */
+    const size_t* col_ptr() const {
+        return _csc_col_ptr;
+    }
+    
+    const unsigned* row_indices() const {
+        return _csc_row_idx;
+    }
+    
+    const T* values() const {
+        return _csc_values;
+    }
+    
+    /** Arreglos de la copia CSR (vacios si no se armo). */
+    const size_t* row_ptr() const {
+        return _row_ptr.data();
     }
     
+    const unsigned* column_indices() const {
+        return _col_idx.data();
+    }
+    
+    const T* row_values() const {
+        return _row_values.data();
+    }
+    
+    /** Pasa la matriz a formato CSC y libera las columnas de armado. 
+     *  Si with_rows es verdadero arma tambien la copia CSR, que hace 
+     *  que A*x se calcule recorriendo filas. */
+    void compress(bool with_rows = true);
+    
     /** Realiza la multiplicacion A^t*A (siendo A == *this) y 
      *  devuelve el resultado por copia. */
     Matrix get_AtA_product() const;
     
 private:
 
+    void bind_owned();
+    void build_rows();
+
+    // Columnas usadas mientras se arma la matriz
     std::vector<SparseVector> _columns;
+    
+    // Formato CSC, cuando los arreglos son propios
+    std::vector<size_t> _col_ptr;
+    std::vector<unsigned> _row_idx;
+    std::vector<T> _values;
+    
+    // Formato CSC que se usa en las cuentas (apunta a los vectores de 
+    // arriba o a los arreglos externos)
+    const size_t* _csc_col_ptr;
+    const unsigned* _csc_row_idx;
+    const T* _csc_values;
+    std::shared_ptr<const void> _storage;
+    
+    // Formato CSR (opcional)
+    std::vector<size_t> _row_ptr;
+    std::vector<unsigned> _col_idx;
+    std::vector<T> _row_values;
+    
     unsigned _num_rows;
+    unsigned _num_columns;
+    bool _compressed;
     
 };
 
-Vector operator*(const SparseMatrix& mat, const Vector& v);
+typedef BasicSparseMatrix<double> SparseMatrix;
+typedef BasicSparseMatrix<float> SparseMatrixF;
+
+/** Producto A*v. Las cuentas se hacen en el tipo de v, asi que con 
+ *  una SparseMatrixF y un v en double se leen los valores en float 
+ *  pero se acumula en double. Esta definido para (double, double), 
+ *  (float, float) y (float, double). */
+template <class T, class U>
+std::vector<U> operator*(const BasicSparseMatrix<T>& mat, const std::vector<U>& v);
+
+/** Realiza la multiplicacion A^t*v (siendo A == mat) sin 
+ *  construir la traspuesta, con los mismos tipos que A*v. */
+template <class T, class U>
+std::vector<U> transposed_product(const BasicSparseMatrix<T>& mat, const std::vector<U>& v);
+
+/** Producto A*X con X densa de n x r. Recorre A una sola vez para 
+ *  todas las columnas de X. */
+Matrix operator*(const SparseMatrix& mat, const Matrix& X);
+
+/** Producto A^t*Y con Y densa de m x r, sin construir la traspuesta. */
+Matrix transposed_product(const SparseMatrix& mat, const Matrix& Y);
 
 struct Metrics;
-std::vector<Vector> least_squares(const SparseMatrix& A, const std::vector<Vector>& bs, Metrics& metrics);
+struct EigenParams;
+struct Regularization;
+std::vector<Vector> least_squares(const SparseMatrix& A, const std::vector<Vector>& bs, const EigenParams& params, const Regularization& reg, Metrics& metrics);
 
-#endif
\ No newline at end of file
+#endif
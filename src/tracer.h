@@ -0,0 +1,148 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/* Recorrido exacto de una grilla (Amanatides-Woo / Siddon).
+ *
+ * La grilla tiene size x size celdas cuadradas de lado cell, con la 
+ * celda (0,0) en la esquina superior izquierda (el eje y va de arriba 
+ * hacia abajo, como en la imagen). El segmento se parametriza como 
+ * P(t) = P0 + t*(P1 - P0), t en [0,1], y en cada paso se avanza hasta 
+ * el proximo cruce con una linea vertical u horizontal de la grilla, 
+ * el que este mas cerca en t. La distancia entre dos cruces 
+ * consecutivos es exactamente la longitud del segmento dentro de la 
+ * celda, y el costo es proporcional a la cantidad de celdas 
+ * atravesadas, no a la cantidad de pixeles. No hay casos especiales: 
+ * los segmentos verticales u horizontales simplemente nunca cruzan 
+ * lineas en uno de los ejes, y al pasar exactamente por una esquina se 
+ * avanza en los dos ejes a la vez. */
+
+/** Recorta la recta que pasa por (x0,y0) y (x1,y1) al cuadrado 
+ *  [0,side]x[0,side], dejando en los mismos parametros los extremos 
+ *  de la cuerda. Devuelve falso si la recta no corta al cuadrado o si 
+ *  los dos puntos coinciden (no hay recta). */
+inline bool clip_line(double& x0, double& y0, double& x1, double& y1, double side)
+{
+    double dx = x1 - x0;
+    double dy = y1 - y0;
+    if (dx == 0.0 and dy == 0.0) {
+        return false;
+    }
+    double tmin = -std::numeric_limits<double>::infinity();
+    double tmax = std::numeric_limits<double>::infinity();
+    
+    const double p[2] = {x0, y0};
+    const double d[2] = {dx, dy};
+    for (unsigned k = 0; k < 2; k++) {
+        if (d[k] == 0.0) {
+            if (p[k] < 0.0 or p[k] > side) {
+                return false;
+            }
+            continue;
+        }
+        double t1 = (0.0 - p[k]) / d[k];
+        double t2 = (side - p[k]) / d[k];
+        if (t1 > t2) {
+            std::swap(t1, t2);
+        }
+        tmin = std::max(tmin, t1);
+        tmax = std::min(tmax, t2);
+    }
+    
+    if (!(tmin < tmax)) {
+        return false;
+    }
+    
+    x1 = x0 + tmax * dx;
+    y1 = y0 + tmax * dy;
+    x0 = x0 + tmin * dx;
+    y0 = y0 + tmin * dy;
+    return true;
+}
+
+/* Celda inicial y parametros de avance en un eje. Si el punto esta 
+ * justo sobre una linea de la grilla y el segmento va hacia atras, 
+ * la celda inicial es la anterior. */
+inline void setup_axis(double p, double d, double cell, unsigned size, int& index, int& step, double& t_max, double& t_delta)
+{
+    index = (int)std::floor(p / cell);
+    if (d < 0.0 and index * cell == p) {
+        index--;
+    }
+    if (index < 0) {
+        index = 0;
+    }
+    if (index >= (int)size) {
+        index = size - 1;
+    }
+    
+    if (d > 0.0) {
+        step = 1;
+        t_max = ((index + 1) * cell - p) / d;
+        t_delta = cell / d;
+    }
+    else if (d < 0.0) {
+        step = -1;
+        t_max = (index * cell - p) / d;
+        t_delta = -cell / d;
+    }
+    else {
+        step = 0;
+        t_max = std::numeric_limits<double>::infinity();
+        t_delta = std::numeric_limits<double>::infinity();
+    }
+}
+
+/** Recorre el segmento (x0,y0)-(x1,y1), que debe estar dentro de la 
+ *  grilla, llamando a visit(i, j, length) por cada celda (columna i, 
+ *  fila j) que atraviesa, en orden, con la longitud del segmento 
+ *  dentro de ella. */
+template <class Visitor>
+void trace_grid(double x0, double y0, double x1, double y1, double cell, unsigned size, Visitor visit)
+{
+    double dx = x1 - x0;
+    double dy = y1 - y0;
+    double length = std::sqrt(dx*dx + dy*dy);
+    if (length == 0.0) {
+        return;
+    }
+    
+    int i, j, step_x, step_y;
+    double t_max_x, t_max_y, t_delta_x, t_delta_y;
+    setup_axis(x0, dx, cell, size, i, step_x, t_max_x, t_delta_x);
+    setup_axis(y0, dy, cell, size, j, step_y, t_max_y, t_delta_y);
+    
+    double t = 0.0;
+    while (true) {
+        double t_next = std::min(std::min(t_max_x, t_max_y), 1.0);
+        if (t_next > t) {
+            visit((unsigned)i, (unsigned)j, (t_next - t) * length);
+        }
+        t = t_next;
+        if (t >= 1.0) {
+            break;
+        }
+        
+        if (t_max_x <= t_max_y) {
+            if (t_max_x == t_max_y) {
+                j += step_y;
+                t_max_y += t_delta_y;
+            }
+            i += step_x;
+            t_max_x += t_delta_x;
+        }
+        else {
+            j += step_y;
+            t_max_y += t_delta_y;
+        }
+        
+        if (i < 0 or j < 0 or i >= (int)size or j >= (int)size) {
+            break;
+        }
+    }
+}
+
+#endif